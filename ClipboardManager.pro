@@ -1,16 +1,21 @@
-QT += core gui widgets
+# LinClip and the parts that build on their own: the HistoryStore library,
+# which the application and the benchmarks link, its tests, and
+# linclip-ctl, which links nothing of ours.
+# qmake6 && make builds the application and linclip-ctl; make check runs
+# the tests, and make sub-benchmarks builds the benchmarks.
 
-CONFIG += c++17
+TEMPLATE = subdirs
 
-SOURCES += \
-    main.cpp \
-    mainwindow.cpp \
-    globalhotkeymanager.cpp  # Add this line
+SUBDIRS = \
+    historystore \
+    app \
+    ctl \
+    tests \
+    benchmarks
 
-HEADERS += \
-    hotkeyprivate.h \
-    mainwindow.h \
-    globalhotkeymanager.h    # Add this line
-
-# Link X11 libraries
-LIBS += -lX11 -lxcb
+app.depends = historystore
+tests.subdir = historystore/tests
+tests.depends = historystore
+benchmarks.depends = historystore
+# Needs QtTest and XTEST, which the application does not
+benchmarks.CONFIG = no_default_target no_default_install
@@ -0,0 +1,13 @@
+# The LinClip executable, put at the top of the build directory
+
+QT += core gui widgets
+
+CONFIG += c++17
+
+TARGET = ClipboardManager
+DESTDIR = $$OUT_PWD/..
+
+SOURCES += \
+    $$PWD/../main.cpp
+
+include(../linclip.pri)
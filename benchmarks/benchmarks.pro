@@ -0,0 +1,24 @@
+# Headless benchmarks for the capture, render and show paths.
+# Built with make sub-benchmarks from the top-level build, after the
+# HistoryStore library; see the README for running them.
+
+QT += core gui widgets testlib
+
+CONFIG += c++17 console testcase no_testcase_installs
+CONFIG -= app_bundle
+
+TARGET = linclip-bench
+
+SOURCES += \
+    tst_linclipbench.cpp \
+    xtestinput.cpp \
+    $$PWD/../controlclient.cpp
+
+HEADERS += \
+    xtestinput.h \
+    $$PWD/../controlclient.h
+
+include(../linclip.pri)
+
+# Synthetic key presses for the hotkey latency benchmark
+LIBS += -lXtst
@@ -0,0 +1,820 @@
+// Headless benchmarks for the paths that decide how LinClip feels:
+// capturing clipboard changes, painting the history and showing the popup,
+// plus memory per entry, the entry records alone, hotkey latency, serving
+// pastes and the control socket.
+//
+// Run under QT_QPA_PLATFORM=offscreen; the hotkey benchmark also needs an
+// X server with XTEST (e.g. xvfb-run) and is skipped without one.
+//
+//   LINCLIP_BENCH_SIZES        History sizes, default "100,1000,10000"
+//   LINCLIP_BENCH_IMAGE_SIZES  Image storm sizes, default "10,100"
+//   LINCLIP_BENCH_JSON         Output file, default "linclip-bench.json"
+//   LINCLIP_BENCH_COMMIT       Recorded as is, to tell runs apart
+//   LINCLIP_BENCH_BUDGET_SCALE Multiplies the startup and first-frame
+//                              budgets, default 1; 0 turns them off
+
+#include "clipboardcapture.h"
+#include "controlclient.h"
+#include "controlserver.h"
+#include "encodedcache.h"
+#include "entrymimedata.h"
+#include "globalhotkeymanager.h"
+#include "historydelegate.h"
+#include "historymodel.h"
+#include "historystore.h"
+#include "imagecodec.h"
+#include "mainwindow.h"
+#include "trace.h"
+#include "xtestinput.h"
+
+#include <QtTest>
+
+#include <QBuffer>
+#include <QClipboard>
+#include <QDateTime>
+#include <QDeadlineTimer>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QGuiApplication>
+#include <QImage>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QListView>
+#include <QMimeData>
+#include <QSettings>
+#include <QStandardPaths>
+#include <QTemporaryDir>
+#include <QThread>
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <random>
+
+#include <unistd.h>
+
+namespace {
+
+constexpr int PaintRepeats = 20;
+constexpr int HotkeyRepeats = 50;
+constexpr int ControlRepeats = 200;
+constexpr int StoreRepeats = 1000;
+constexpr int ScreenshotBurst = 50;
+constexpr int PasteRepeats = 20;
+constexpr int ControlPageSize = 100;
+constexpr qsizetype ControlLargeTextBytes = 4 * 1024 * 1024;
+const QString HotkeySequence = QStringLiteral("Ctrl+Alt+Shift+F12");
+
+// Regression budgets for showPopup(), in ms, at every history size. Far
+// above what a healthy build takes, so they only trip when eager work
+// creeps back into startup or the popup is no longer kept warm.
+constexpr double StartupReadyBudgetMs = 1500;
+constexpr double FirstFrameBudgetMs = 150;
+constexpr double FrameBudgetMs = 50;
+
+QList<int> sizesFromEnvironment(const char *name, const QString &fallback)
+{
+    const QString value = qEnvironmentVariable(name, fallback);
+    QList<int> sizes;
+    for (const QString &part : value.split(',', Qt::SkipEmptyParts)) {
+        const int size = part.trimmed().toInt();
+        if (size > 0)
+            sizes.append(size);
+    }
+    return sizes;
+}
+
+// Roughly what people copy: a line or two of prose or code
+QString sampleText(int i)
+{
+    return QString("Entry %1: the quick brown fox jumps over the lazy dog; "
+                   "int value = compute(%1, \"key-%2\");").arg(i).arg(i * 2654435761u, 8, 16, QChar('0'));
+}
+
+QByteArray samplePng(int i)
+{
+    QImage image(256, 256, QImage::Format_ARGB32);
+    for (int y = 0; y < image.height(); ++y) {
+        auto *line = reinterpret_cast<QRgb *>(image.scanLine(y));
+        for (int x = 0; x < image.width(); ++x)
+            line[x] = qRgb((x + i) & 0xff, (y * 3) & 0xff, (x ^ y ^ i) & 0xff);
+    }
+    QByteArray png;
+    QBuffer buffer(&png);
+    buffer.open(QIODevice::WriteOnly);
+    image.save(&buffer, "PNG");
+    return png;
+}
+
+// A 1080p window with text-like detail, and a small changing region (a
+// caret, a clock) that sets variant apart
+QImage sampleScreenshot(int variant)
+{
+    QImage image(1920, 1080, QImage::Format_RGB32);
+    for (int y = 0; y < image.height(); ++y) {
+        auto *line = reinterpret_cast<QRgb *>(image.scanLine(y));
+        for (int x = 0; x < image.width(); ++x)
+            line[x] = ((x / 7 + y / 13) % 5 == 0) ? qRgb(40, 40, 48) : qRgb(250, 250, 250 - (y / 60) * 2);
+    }
+    for (int y = 600; y < 640; ++y) {
+        auto *line = reinterpret_cast<QRgb *>(image.scanLine(y));
+        for (int x = 300; x < 300 + 12 * (variant + 1) && x < image.width(); ++x)
+            line[x] = qRgb((x * variant) & 0xff, y & 0xff, variant * 5);
+    }
+    return image;
+}
+
+// Spins the event loop (worker results arrive as queued calls) until
+// done() holds. Busy, so that the wake-up itself is not measured.
+bool spinUntil(const std::function<bool()> &done, int timeoutMs = 30000)
+{
+    const QDeadlineTimer deadline(timeoutMs);
+    while (!done()) {
+        if (deadline.hasExpired())
+            return false;
+        QCoreApplication::processEvents(QEventLoop::AllEvents);
+    }
+    return true;
+}
+
+// VmRSS or VmHWM from /proc/self/status, in bytes
+qint64 memoryFromProc(const char *field)
+{
+    QFile status("/proc/self/status");
+    if (!status.open(QIODevice::ReadOnly))
+        return -1;
+    const QByteArray prefix = QByteArray(field) + ':';
+    for (const QByteArray &line : status.readAll().split('\n')) {
+        if (line.startsWith(prefix))
+            return line.mid(prefix.size()).trimmed().split(' ').first().toLongLong() * 1024;
+    }
+    return -1;
+}
+
+// Resets VmHWM to the current RSS (Linux 4.0 and later)
+void resetPeakMemory()
+{
+    QFile clearRefs("/proc/self/clear_refs");
+    if (clearRefs.open(QIODevice::WriteOnly))
+        clearRefs.write("5");
+}
+
+// The stage's most recent event in the trace; a zero end if there is none
+Trace::Event lastTraceEvent(Trace::Stage stage)
+{
+    Trace::Event last {};
+    for (const Trace::Event &event : Trace::snapshot()) {
+        if (event.stage == stage && event.end > last.end)
+            last = event;
+    }
+    return last;
+}
+
+double percentile(QList<double> values, double p)
+{
+    if (values.isEmpty())
+        return 0;
+    std::sort(values.begin(), values.end());
+    return values.at(qMin(values.size() - 1, int(p * values.size())));
+}
+
+} // namespace
+
+class LinClipBench : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+    void cleanupTestCase();
+
+    void captureText_data();
+    void captureText();
+    void captureImages_data();
+    void captureImages();
+    void captureStorm();
+    void screenshotBurst_data();
+    void screenshotBurst();
+    void renderHistory_data();
+    void renderHistory();
+    void showPopup_data();
+    void showPopup();
+    void hotkeyLatency();
+    void controlApi_data();
+    void controlApi();
+    void pasteEntry_data();
+    void pasteEntry();
+    void storeRecords_data();
+    void storeRecords();
+
+private:
+    void record(const QString &name, int entries, const QString &unit, double value);
+    void fillHistory(HistoryModel *model, int entries);
+
+    QList<int> m_sizes;
+    QList<int> m_imageSizes;
+    QJsonArray m_results;
+};
+
+void LinClipBench::initTestCase()
+{
+    // Keeps settings and storage away from the user's real ones
+    QStandardPaths::setTestModeEnabled(true);
+    QCoreApplication::setOrganizationName("LinClip");
+    QCoreApplication::setApplicationName("LinClipBench");
+    QSettings().clear();
+    // MainWindow instances here must not take over a running LinClip's socket
+    QSettings().setValue("Control/socket", false);
+    QDir(QStandardPaths::writableLocation(QStandardPaths::AppDataLocation)).removeRecursively();
+
+    m_sizes = sizesFromEnvironment("LINCLIP_BENCH_SIZES", "100,1000,10000");
+    m_imageSizes = sizesFromEnvironment("LINCLIP_BENCH_IMAGE_SIZES", "10,100");
+    QVERIFY(!m_sizes.isEmpty());
+}
+
+void LinClipBench::cleanupTestCase()
+{
+    QJsonObject report;
+    report["version"] = 1;
+    report["timestamp"] = QDateTime::currentDateTimeUtc().toString(Qt::ISODate);
+    report["commit"] = qEnvironmentVariable("LINCLIP_BENCH_COMMIT");
+    report["qt"] = QString(qVersion());
+    report["platform"] = QGuiApplication::platformName();
+    report["cpus"] = QThread::idealThreadCount();
+    report["results"] = m_results;
+
+    const QString path = qEnvironmentVariable("LINCLIP_BENCH_JSON", "linclip-bench.json");
+    QFile file(path);
+    QVERIFY2(file.open(QIODevice::WriteOnly | QIODevice::Truncate), qPrintable(file.errorString()));
+    file.write(QJsonDocument(report).toJson());
+    qInfo("Results written to %s", qPrintable(QFileInfo(file).absoluteFilePath()));
+}
+
+void LinClipBench::record(const QString &name, int entries, const QString &unit, double value)
+{
+    QJsonObject result;
+    result["name"] = name;
+    result["entries"] = entries;
+    result["unit"] = unit;
+    result["value"] = value;
+    m_results.append(result);
+    qInfo("%-32s %7d entries  %12.3f %s", qPrintable(name), entries, value, qPrintable(unit));
+}
+
+void LinClipBench::fillHistory(HistoryModel *model, int entries)
+{
+    model->setMaxEntries(qMax(entries, HistoryModel::DefaultMaxEntries));
+    for (int i = 0; i < entries; ++i)
+        model->prepend(sampleText(i));
+}
+
+// --- Capture ---
+
+void LinClipBench::captureText_data()
+{
+    QTest::addColumn<int>("entries");
+    QTest::addColumn<bool>("persistent");
+    for (int size : m_sizes) {
+        QTest::addRow("memory/%d", size) << size << false;
+        QTest::addRow("disk/%d", size) << size << true;
+    }
+}
+
+// Clipboard change to model row, one entry at a time
+void LinClipBench::captureText()
+{
+    QFETCH(int, entries);
+    QFETCH(bool, persistent);
+    const QString prefix = persistent ? "capture.text.disk" : "capture.text.memory";
+
+    QTemporaryDir storage;
+    HistoryModel model;
+    model.setMaxEntries(qMax(entries, HistoryModel::DefaultMaxEntries));
+    if (persistent)
+        QVERIFY(model.openStorage(storage.path()));
+
+    QClipboard *clipboard = QGuiApplication::clipboard();
+    ClipboardCapture capture(clipboard);
+    capture.setDebounceInterval(0);
+    connect(&capture, &ClipboardCapture::captured, &model,
+            qOverload<const CapturedContent &, const OriginalFormats::List &>(&HistoryModel::prepend));
+
+    const qint64 rssBefore = memoryFromProc("VmRSS");
+    resetPeakMemory();
+    QElapsedTimer timer;
+    timer.start();
+    for (int i = 0; i < entries; ++i) {
+        clipboard->setText(sampleText(i));
+        QVERIFY(spinUntil([&]() { return model.rowCount() == i + 1; }));
+    }
+    const double elapsedMs = timer.nsecsElapsed() / 1e6;
+
+    record(prefix + ".per_entry", entries, "ms", elapsedMs / entries);
+    record(prefix + ".peak_rss_per_entry", entries, "bytes",
+           double(memoryFromProc("VmHWM") - rssBefore) / entries);
+}
+
+void LinClipBench::captureImages_data()
+{
+    QTest::addColumn<int>("entries");
+    for (int size : m_imageSizes)
+        QTest::addRow("%d", size) << size;
+}
+
+// Encoded PNG on the clipboard to a compressed history entry
+void LinClipBench::captureImages()
+{
+    QFETCH(int, entries);
+
+    QList<QByteArray> images;
+    for (int i = 0; i < entries; ++i)
+        images.append(samplePng(i));
+
+    HistoryModel model;
+    model.setMaxEntries(qMax(entries, HistoryModel::DefaultMaxEntries));
+    QClipboard *clipboard = QGuiApplication::clipboard();
+    ClipboardCapture capture(clipboard);
+    capture.setDebounceInterval(0);
+    connect(&capture, &ClipboardCapture::captured, &model,
+            qOverload<const CapturedContent &, const OriginalFormats::List &>(&HistoryModel::prepend));
+
+    const qint64 rssBefore = memoryFromProc("VmRSS");
+    resetPeakMemory();
+    QElapsedTimer timer;
+    timer.start();
+    for (int i = 0; i < entries; ++i) {
+        auto *mimeData = new QMimeData;
+        mimeData->setData("image/png", images.at(i));
+        clipboard->setMimeData(mimeData);
+        QVERIFY(spinUntil([&]() { return model.rowCount() == i + 1; }));
+    }
+    const double captureMs = timer.nsecsElapsed() / 1e6;
+    // Compression runs behind the capture; wait for it to drain too
+    QVERIFY(spinUntil([&]() { return model.memoryStats().pendingImageBytes == 0; }));
+    const double settledMs = timer.nsecsElapsed() / 1e6;
+
+    record("capture.image.per_entry", entries, "ms", captureMs / entries);
+    record("capture.image.settled_per_entry", entries, "ms", settledMs / entries);
+    record("capture.image.peak_rss_per_entry", entries, "bytes",
+           double(memoryFromProc("VmHWM") - rssBefore) / entries);
+}
+
+// A burst of changes faster than the debounce interval, as terminals send
+void LinClipBench::captureStorm()
+{
+    for (int size : m_sizes) {
+        HistoryModel model;
+        QClipboard *clipboard = QGuiApplication::clipboard();
+        ClipboardCapture capture(clipboard);
+        connect(&capture, &ClipboardCapture::captured, &model,
+                qOverload<const CapturedContent &, const OriginalFormats::List &>(&HistoryModel::prepend));
+
+        QElapsedTimer timer;
+        timer.start();
+        for (int i = 0; i < size; ++i)
+            clipboard->setText(sampleText(i));
+        const double burstMs = timer.nsecsElapsed() / 1e6;
+        QVERIFY(spinUntil([&]() { return model.rowCount() > 0; }));
+        const double settledMs = timer.nsecsElapsed() / 1e6;
+        // Anything else still on its way is picked up here
+        QTest::qWait(4 * ClipboardCapture::DebounceMs);
+
+        record("capture.storm.burst", size, "ms", burstMs);
+        record("capture.storm.settled", size, "ms", settledMs);
+        record("capture.storm.entries", size, "count", model.rowCount());
+    }
+}
+
+void LinClipBench::screenshotBurst_data()
+{
+    QTest::addColumn<bool>("persistent");
+    QTest::addRow("memory") << false;
+    QTest::addRow("disk") << true;
+}
+
+// Near-identical screenshots in a row, which share all but a few tiles:
+// what they take at rest against one image on its own, and assembling
+// one again without the decoded cache
+void LinClipBench::screenshotBurst()
+{
+    QFETCH(bool, persistent);
+    const QString prefix = persistent ? "store.screenshot_burst.disk" : "store.screenshot_burst.memory";
+
+    QTemporaryDir storage;
+    HistoryModel model;
+    model.setImageCacheBudget(0);
+    if (persistent)
+        QVERIFY(model.openStorage(storage.path()));
+
+    const qint64 oneImage = ImageCodec::compress(sampleScreenshot(0)).size();
+    for (int i = 0; i < ScreenshotBurst; ++i)
+        model.prepend(sampleScreenshot(i));
+    QVERIFY(spinUntil([&]() { return model.memoryStats().pendingImageBytes == 0; }));
+    const HistoryModel::MemoryStats stats = model.memoryStats();
+
+    QList<double> assembled;
+    QElapsedTimer timer;
+    for (int i = 0; i < PaintRepeats; ++i) {
+        timer.start();
+        const QImage image = model.contentAt(i % ScreenshotBurst).value<QImage>();
+        assembled.append(timer.nsecsElapsed() / 1e6);
+        QCOMPARE(image, sampleScreenshot(ScreenshotBurst - 1 - i % ScreenshotBurst));
+    }
+
+    record(prefix + ".bytes", ScreenshotBurst, "bytes", stats.compressedImageBytes);
+    record(prefix + ".images_worth", ScreenshotBurst, "images", double(stats.compressedImageBytes) / oneImage);
+    record(prefix + ".saved", ScreenshotBurst, "bytes", stats.sharedTileSavings);
+    record(prefix + ".assemble.p50", ScreenshotBurst, "ms", percentile(assembled, 0.50));
+}
+
+// --- Render and show ---
+
+void LinClipBench::renderHistory_data()
+{
+    QTest::addColumn<int>("entries");
+    for (int size : m_sizes)
+        QTest::addRow("%d", size) << size;
+}
+
+// Painting the list as the popup does, at the top and while scrolling
+void LinClipBench::renderHistory()
+{
+    QFETCH(int, entries);
+
+    HistoryModel model;
+    fillHistory(&model, entries);
+
+    QListView view;
+    view.setModel(&model);
+    view.setItemDelegate(new HistoryDelegate(&view));
+    view.setUniformItemSizes(true);
+    view.setLayoutMode(QListView::Batched);
+    view.setIconSize(QSize(HistoryDelegate::IconSize, HistoryDelegate::IconSize));
+    view.resize(400, 500);
+
+    QElapsedTimer timer;
+    timer.start();
+    view.show();
+    QVERIFY(QTest::qWaitForWindowExposed(&view));
+    record("render.first_show", entries, "ms", timer.nsecsElapsed() / 1e6);
+
+    timer.restart();
+    for (int i = 0; i < PaintRepeats; ++i)
+        view.viewport()->repaint();
+    record("render.paint", entries, "ms", timer.nsecsElapsed() / 1e6 / PaintRepeats);
+
+    timer.restart();
+    for (int i = 0; i < PaintRepeats; ++i) {
+        view.scrollTo(model.index(int((i * 7919LL) % entries)));
+        view.viewport()->repaint();
+    }
+    record("render.scroll_paint", entries, "ms", timer.nsecsElapsed() / 1e6 / PaintRepeats);
+}
+
+void LinClipBench::showPopup_data()
+{
+    QTest::addColumn<int>("entries");
+    for (int size : m_sizes)
+        QTest::addRow("%d", size) << size;
+}
+
+// Start-up with a persisted history, until the deferred part is done and
+// the popup is warm, then the hotkey's show path up to the first frame.
+// Fails when a budget is exceeded.
+void LinClipBench::showPopup()
+{
+    QFETCH(int, entries);
+
+    const QString storage = QStandardPaths::writableLocation(QStandardPaths::AppDataLocation);
+    QDir(storage).removeRecursively();
+    {
+        HistoryModel model;
+        QVERIFY(model.openStorage(storage));
+        fillHistory(&model, entries);
+    }
+    QSettings settings;
+    settings.setValue("History/maxEntries", qMax(entries, HistoryModel::DefaultMaxEntries));
+    settings.setValue("History/persistent", true);
+    settings.sync();
+
+    QElapsedTimer timer;
+    timer.start();
+    MainWindow window;
+    record("popup.startup", entries, "ms", timer.nsecsElapsed() / 1e6);
+    QVERIFY(spinUntil([&]() { return window.isReady(); }));
+    const double readyMs = timer.nsecsElapsed() / 1e6;
+    record("popup.startup_ready", entries, "ms", readyMs);
+
+    // As the hotkey thread delivers a press; the frame is timed by the
+    // window itself, up to the end of its first paint
+    QList<double> frames;
+    for (const char *name : { "popup.first_show", "popup.show" }) {
+        timer.restart();
+        const qint64 pressedAt = Trace::now();
+        Trace::setMark(Trace::HotkeyReceivedMark, pressedAt);
+        QVERIFY(QMetaObject::invokeMethod(&window, "onHotkeyPressed", Q_ARG(QString, "toggle")));
+        QVERIFY(QTest::qWaitForWindowExposed(&window));
+        record(name, entries, "ms", timer.nsecsElapsed() / 1e6);
+        QVERIFY(spinUntil([&]() { return lastTraceEvent(Trace::HotkeyToPaint).start == pressedAt; }));
+        const Trace::Event frame = lastTraceEvent(Trace::HotkeyToPaint);
+        frames.append((frame.end - frame.start) / 1e6);
+        QVERIFY(QMetaObject::invokeMethod(&window, "toggleVisibility"));
+        QVERIFY(spinUntil([&]() { return !window.isVisible(); }));
+    }
+    record("popup.first_frame", entries, "ms", frames.first());
+    record("popup.frame", entries, "ms", frames.last());
+
+    const double scale = qEnvironmentVariable("LINCLIP_BENCH_BUDGET_SCALE", "1").toDouble();
+    auto withinBudget = [scale](double ms, double budgetMs) { return scale <= 0 || ms <= budgetMs * scale; };
+    QVERIFY2(withinBudget(readyMs, StartupReadyBudgetMs), "Startup to ready is over its budget");
+    QVERIFY2(withinBudget(frames.first(), FirstFrameBudgetMs), "First frame after startup is over its budget");
+    QVERIFY2(withinBudget(frames.last(), FrameBudgetMs), "Frame on a later show is over its budget");
+}
+
+// --- Hotkey ---
+
+// Synthetic key press to hotkeyPressed(): emitted on the hotkey thread,
+// and delivered to the GUI thread as MainWindow receives it
+void LinClipBench::hotkeyLatency()
+{
+    if (!XTestInput::isAvailable())
+        QSKIP("Needs an X server with XTEST, e.g. xvfb-run");
+
+    QThread thread;
+    GlobalHotkeyManager manager({ { HotkeySequence, "bench" } });
+    manager.moveToThread(&thread);
+    connect(&thread, &QThread::started, &manager, &GlobalHotkeyManager::run);
+
+    QElapsedTimer timer;
+    std::atomic<qint64> emittedAt { -1 };
+    qint64 deliveredAt = -1;
+    connect(&manager, &GlobalHotkeyManager::hotkeyPressed, this,
+            [&](const QString &) { emittedAt = timer.nsecsElapsed(); }, Qt::DirectConnection);
+    connect(&manager, &GlobalHotkeyManager::hotkeyPressed, this,
+            [&](const QString &) { deliveredAt = timer.nsecsElapsed(); }, Qt::QueuedConnection);
+
+    thread.start();
+    // Let the grab reach the server before pressing anything
+    QTest::qWait(200);
+
+    QList<double> emitted;
+    QList<double> delivered;
+    for (int i = 0; i < HotkeyRepeats; ++i) {
+        emittedAt = -1;
+        deliveredAt = -1;
+        timer.start();
+        QVERIFY(XTestInput::sendKeySequence(HotkeySequence));
+        QVERIFY2(spinUntil([&]() { return deliveredAt >= 0; }, 2000), "Hotkey never fired; is it grabbed elsewhere?");
+        emitted.append(emittedAt / 1e3);
+        delivered.append(deliveredAt / 1e3);
+    }
+
+    manager.stop();
+    thread.quit();
+    QVERIFY(thread.wait(5000));
+
+    record("hotkey.signal.p50", HotkeyRepeats, "us", percentile(emitted, 0.50));
+    record("hotkey.signal.p95", HotkeyRepeats, "us", percentile(emitted, 0.95));
+    record("hotkey.delivered.p50", HotkeyRepeats, "us", percentile(delivered, 0.50));
+    record("hotkey.delivered.p95", HotkeyRepeats, "us", percentile(delivered, 0.95));
+}
+
+// --- Control socket ---
+
+void LinClipBench::controlApi_data()
+{
+    QTest::addColumn<int>("entries");
+    for (int size : m_sizes)
+        QTest::addRow("%d", size) << size;
+}
+
+// A local client against a server on this thread: request round trips,
+// paging through the whole history, searching, and a large text handed
+// over as a memfd
+void LinClipBench::controlApi()
+{
+    QFETCH(int, entries);
+
+    HistoryModel model;
+    fillHistory(&model, entries);
+    QString large;
+    while (large.size() < ControlLargeTextBytes)
+        large += sampleText(large.size()) + '\n';
+    model.prepend(large);
+    const QString largeKey = ControlProtocol::keyToString(model.entryInfo(0).contentKey);
+
+    QTemporaryDir directory;
+    ControlServer server(&model);
+    QVERIFY(server.listen(directory.filePath("control.sock")));
+
+    QList<double> roundTrips;
+    QList<double> searches;
+    double listMs = 0;
+    int listed = 0;
+    double getMs = 0;
+    qint64 received = 0;
+    QString error;
+    std::atomic<bool> done { false };
+
+    // The client blocks, so it runs on a thread of its own while this one serves
+    std::unique_ptr<QThread> client(QThread::create([&]() {
+        ControlClient control;
+        QJsonArray responses;
+        QElapsedTimer timer;
+        auto failed = [&]() {
+            error = control.errorString();
+            done = true;
+        };
+        if (!control.connectToServer(server.path()))
+            return failed();
+
+        for (int i = 0; i < ControlRepeats; ++i) {
+            timer.start();
+            if (!control.call({ QJsonObject { { "op", "list" }, { "from", 0 }, { "count", 1 } } }, &responses))
+                return failed();
+            roundTrips.append(timer.nsecsElapsed() / 1e3);
+        }
+
+        // As many pages per message as a batch takes
+        timer.start();
+        for (int from = 0; from <= entries;) {
+            QJsonArray batch;
+            for (; batch.size() < ControlProtocol::MaxBatchSize && from <= entries; from += ControlPageSize)
+                batch.append(QJsonObject { { "op", "list" }, { "from", from }, { "count", ControlPageSize } });
+            if (!control.call(batch, &responses))
+                return failed();
+            for (const QJsonValue &response : responses)
+                listed += response.toObject().value("entries").toArray().size();
+        }
+        listMs = timer.nsecsElapsed() / 1e6;
+
+        for (int i = 0; i < ControlRepeats; ++i) {
+            timer.start();
+            const QJsonObject search { { "op", "search" }, { "query", QString("fox %1").arg(i) }, { "limit", 50 } };
+            if (!control.call({ search }, &responses))
+                return failed();
+            searches.append(timer.nsecsElapsed() / 1e3);
+        }
+
+        timer.start();
+        for (int i = 0; i < PaintRepeats; ++i) {
+            std::vector<int> fds;
+            if (!control.call({ QJsonObject { { "op", "get" }, { "key", largeKey } } }, &responses, &fds))
+                return failed();
+            // Read it through, as a consumer would
+            for (int fd : fds) {
+                received += ControlProtocol::readPayload(fd).size();
+                close(fd);
+            }
+        }
+        getMs = timer.nsecsElapsed() / 1e6;
+        done = true;
+    }));
+    client->start();
+    QVERIFY(spinUntil([&]() { return done.load(); }, 120000));
+    QVERIFY(client->wait(5000));
+    QVERIFY2(error.isEmpty(), qPrintable(error));
+    QCOMPARE(listed, entries + 1);
+    QCOMPARE(received, qint64(PaintRepeats) * model.utf8TextAt(0).size());
+
+    record("control.roundtrip.p50", entries, "us", percentile(roundTrips, 0.50));
+    record("control.roundtrip.p99", entries, "us", percentile(roundTrips, 0.99));
+    record("control.list.entries_per_s", entries, "entries/s", listed / (listMs / 1e3));
+    record("control.search.p50", entries, "us", percentile(searches, 0.50));
+    record("control.search.p99", entries, "us", percentile(searches, 0.99));
+    record("control.get_large.throughput", entries, "MB/s", received / 1e6 / (getMs / 1e3));
+}
+
+// --- Paste ---
+
+void LinClipBench::pasteEntry_data()
+{
+    QTest::addColumn<bool>("image");
+    QTest::addColumn<QString>("mimeType");
+    QTest::addRow("text") << false << "text/plain";
+    QTest::addRow("png") << true << "image/png";
+    QTest::addRow("bmp") << true << "image/bmp";
+}
+
+// What a paste of an activated entry waits for, as the X server asks for
+// it: encoding on every request, as setImage()/setText() did, against the
+// first request and the ones after it served from the EncodedCache. Also
+// checks that the original formats survive a restart.
+void LinClipBench::pasteEntry()
+{
+    QFETCH(bool, image);
+    QFETCH(QString, mimeType);
+    const QString prefix = "paste." + QString(QTest::currentDataTag());
+
+    QVariant content = image ? QVariant(sampleScreenshot(0)) : QVariant(sampleText(0).repeated(1000));
+    const OriginalFormats::List originals = { { "text/html", "<p>" + sampleText(0).toUtf8() + "</p>" } };
+    QTemporaryDir storage;
+    {
+        HistoryModel model;
+        QVERIFY(model.openStorage(storage.path()));
+        model.prepend(content, originals);
+        QVERIFY(spinUntil([&]() { return model.memoryStats().pendingImageBytes == 0; }));
+    }
+    HistoryModel model;
+    QVERIFY(model.openStorage(storage.path()));
+    QCOMPARE(model.originalFormatsAt(0), originals);
+    content = model.contentAt(0);
+
+    QList<double> uncached;
+    QElapsedTimer timer;
+    for (int i = 0; i < PasteRepeats; ++i) {
+        timer.start();
+        QVERIFY(!EncodedCache::encode(content, mimeType).isEmpty());
+        uncached.append(timer.nsecsElapsed() / 1e6);
+    }
+
+    // As on activation: image/png or text/plain is prefetched, and a paste
+    // right away waits for what is left of that encoding
+    auto cache = std::make_shared<EncodedCache>();
+    EntryMimeData mimeData(model.contentKeyAt(0), content, model.originalFormatsAt(0), cache);
+    timer.start();
+    const QByteArray first = mimeData.data(mimeType);
+    const double firstMs = timer.nsecsElapsed() / 1e6;
+    QVERIFY(!first.isEmpty());
+
+    QList<double> repeated;
+    for (int i = 0; i < PasteRepeats; ++i) {
+        timer.start();
+        QCOMPARE(mimeData.data(mimeType).size(), first.size());
+        repeated.append(timer.nsecsElapsed() / 1e6);
+    }
+    QCOMPARE(mimeData.data("text/html"), originals.first().second);
+
+    record(prefix + ".uncached.p50", 1, "ms", percentile(uncached, 0.50));
+    record(prefix + ".first", 1, "ms", firstMs);
+    record(prefix + ".repeated.p50", 1, "ms", percentile(repeated, 0.50));
+}
+
+// --- Store ---
+
+void LinClipBench::storeRecords_data()
+{
+    QTest::addColumn<int>("entries");
+    for (int size : m_sizes)
+        QTest::addRow("%d", size) << size;
+}
+
+// HistoryStore alone, without the model around it: what an entry costs
+// beyond its payload, and its operations at this size
+void LinClipBench::storeRecords()
+{
+    QFETCH(int, entries);
+
+    HistoryStore store;
+    QElapsedTimer timer;
+    timer.start();
+    for (int i = 0; i < entries; ++i) {
+        HistoryStore::Record record;
+        record.contentKey = quint64(i) + 1;
+        record.timestamp = i;
+        record.logId = quint64(i) + 1;
+        record.storedBytes = record.textBytes = sampleText(i).size();
+        record.lineCount = 1;
+        record.label = sampleText(i);
+        store.prepend(record);
+    }
+    const double prependNs = timer.nsecsElapsed() / double(entries);
+    QCOMPARE(store.size(), entries);
+
+    // Labels are part of a record, so take them out to see the fixed part
+    qint64 labelBytes = 0;
+    for (int row = 0; row < entries; ++row)
+        labelBytes += store.label(store.idAt(row)).capacity() * qint64(sizeof(QChar));
+    const qint64 recordBytes = store.recordBytes();
+
+    std::mt19937 random(entries);
+    std::uniform_int_distribution<int> rows(0, entries - 1);
+    QList<HistoryStore::Id> ids;
+    for (int i = 0; i < StoreRepeats; ++i)
+        ids.append(store.idAt(rows(random)));
+
+    timer.start();
+    int found = 0;
+    for (HistoryStore::Id id : ids)
+        found += store.rowOf(id) >= 0;
+    const double rowOfNs = timer.nsecsElapsed() / double(ids.size());
+    QCOMPARE(found, StoreRepeats);
+
+    timer.start();
+    for (HistoryStore::Id id : ids)
+        store.moveToFront(id, 0);
+    const double moveNs = timer.nsecsElapsed() / double(ids.size());
+    QCOMPARE(store.rowOf(ids.last()), 0);
+
+    record("store.record_bytes_per_entry", entries, "bytes", double(recordBytes) / entries);
+    record("store.fixed_bytes_per_entry", entries, "bytes", double(recordBytes - labelBytes) / entries);
+    record("store.prepend", entries, "ns", prependNs);
+    record("store.row_of", entries, "ns", rowOfNs);
+    record("store.move_to_front", entries, "ns", moveNs);
+}
+
+QTEST_MAIN(LinClipBench)
+#include "tst_linclipbench.moc"
@@ -0,0 +1,78 @@
+#include "xtestinput.h"
+
+#include <QStringList>
+#include <QVector>
+
+#include <X11/Xlib.h>
+#include <X11/extensions/XTest.h>
+#include <X11/keysym.h>
+
+namespace {
+
+Display *display()
+{
+    // Opened once and kept for the life of the process
+    static Display *const connection = []() -> Display * {
+        Display *d = XOpenDisplay(nullptr);
+        int eventBase, errorBase, major, minor;
+        if (d && !XTestQueryExtension(d, &eventBase, &errorBase, &major, &minor)) {
+            XCloseDisplay(d);
+            return nullptr;
+        }
+        return d;
+    }();
+    return connection;
+}
+
+KeySym keysymFor(const QString &part, bool modifier)
+{
+    if (!modifier)
+        return XStringToKeysym(part.toLatin1().constData());
+
+    const QString mod = part.toLower();
+    if (mod == "ctrl" || mod == "control")
+        return XK_Control_L;
+    if (mod == "alt")
+        return XK_Alt_L;
+    if (mod == "shift")
+        return XK_Shift_L;
+    if (mod == "super" || mod == "meta" || mod == "win")
+        return XK_Super_L;
+    return NoSymbol;
+}
+
+} // namespace
+
+namespace XTestInput {
+
+bool isAvailable()
+{
+    return display() != nullptr;
+}
+
+bool sendKeySequence(const QString &sequence)
+{
+    Display *d = display();
+    const QStringList parts = sequence.split('+', Qt::SkipEmptyParts);
+    if (!d || parts.isEmpty())
+        return false;
+
+    QVector<KeyCode> keycodes;
+    for (int i = 0; i < parts.size(); ++i) {
+        const KeySym keysym = keysymFor(parts.at(i).trimmed(), i < parts.size() - 1);
+        const KeyCode keycode = keysym != NoSymbol ? XKeysymToKeycode(d, keysym) : 0;
+        if (keycode == 0)
+            return false;
+        keycodes.append(keycode);
+    }
+
+    // Modifiers first, key last; released in reverse
+    for (KeyCode keycode : keycodes)
+        XTestFakeKeyEvent(d, keycode, True, CurrentTime);
+    for (auto it = keycodes.crbegin(); it != keycodes.crend(); ++it)
+        XTestFakeKeyEvent(d, *it, False, CurrentTime);
+    XFlush(d);
+    return true;
+}
+
+} // namespace XTestInput
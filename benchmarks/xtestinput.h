@@ -0,0 +1,16 @@
+#pragma once
+
+#include <QString>
+
+// Synthesizes key presses through the XTEST extension, so that passive
+// grabs on the root window (the hotkey manager's) see them like real ones.
+// The X11 headers stay in the .cpp; their macros clash with Qt's.
+namespace XTestInput {
+
+// True when $DISPLAY can be opened and has the XTEST extension
+bool isAvailable();
+
+// Presses and releases a sequence such as "Ctrl+Alt+Shift+F12"
+bool sendKeySequence(const QString &sequence);
+
+} // namespace XTestInput
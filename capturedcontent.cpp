@@ -0,0 +1,54 @@
+#include "capturedcontent.h"
+#include "contenthash.h"
+
+#include <QImage>
+#include <QStringView>
+
+#include <limits>
+
+namespace {
+
+// The label and line count of a text, in one pass over it. The scan is
+// QStringView::indexOf(QChar), which is vectorized, so even a clip of tens
+// of megabytes takes milliseconds and nothing is allocated per line.
+void makePreview(QStringView text, CapturedContent *prepared)
+{
+    qsizetype firstBreak = -1;
+    quint32 breaks = 0;
+    for (qsizetype pos = text.indexOf(u'\n'); pos >= 0; pos = text.indexOf(u'\n', pos + 1)) {
+        if (firstBreak < 0)
+            firstBreak = pos;
+        if (breaks < std::numeric_limits<quint32>::max())
+            ++breaks;
+    }
+
+    const qsizetype firstLine = firstBreak < 0 ? text.size() : firstBreak;
+    prepared->label = text.left(qMin<qsizetype>(firstLine, CapturedContent::MaxLabelLength)).trimmed().toString();
+    // A trailing line break does not start another line
+    prepared->lineCount = text.isEmpty() ? 0 : breaks + (text.endsWith(u'\n') ? 0 : 1);
+}
+
+} // namespace
+
+CapturedContent CapturedContent::prepare(const QVariant &content)
+{
+    CapturedContent prepared = known(content, ContentHash::of(content));
+    if (content.typeId() == QMetaType::QImage) {
+        const QImage image = content.value<QImage>();
+        prepared.label = QString("[Image %1x%2]").arg(image.width()).arg(image.height());
+    } else {
+        const QString text = content.toString();
+        makePreview(text, &prepared);
+        prepared.utf8 = text.toUtf8();
+    }
+    prepared.prepared = true;
+    return prepared;
+}
+
+CapturedContent CapturedContent::known(const QVariant &content, quint64 contentKey)
+{
+    CapturedContent prepared;
+    prepared.content = content;
+    prepared.contentKey = contentKey;
+    return prepared;
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <QByteArray>
+#include <QString>
+#include <QVariant>
+
+// Captured content together with everything HistoryModel::prepend()
+// derives from it: the fingerprint, the label and line count, and for a
+// text the UTF-8 the log stores. Each takes a pass over the whole clip, so
+// ClipboardCapture prepares them on its worker and adding the entry costs
+// the GUI thread none.
+struct CapturedContent {
+    static constexpr int MaxLabelLength = 256;
+
+    QVariant content;       // QString or QImage
+    quint64 contentKey = 0; // ContentHash fingerprint
+    QString label;
+    quint32 lineCount = 0;  // Text only
+    QByteArray utf8;        // Text only
+    bool prepared = false;  // Whether the three above are filled in
+
+    // Computes everything on the calling thread
+    static CapturedContent prepare(const QVariant &content);
+    // Content whose fingerprint is known already, e.g. a history entry
+    // pasted again: only good for moving that entry to the front
+    static CapturedContent known(const QVariant &content, quint64 contentKey);
+};
@@ -0,0 +1,326 @@
+#include "clipboardcapture.h"
+#include "entrymimedata.h"
+#include "trace.h"
+
+#include <QBuffer>
+#include <QClipboard>
+#include <QFileInfo>
+#include <QImage>
+#include <QImageReader>
+#include <QMimeData>
+#include <QUrl>
+
+namespace {
+
+// Lossless and understood by every toolkit, so preferred when offered
+const QString PreferredImageFormat = QStringLiteral("image/png");
+
+// The image/* format to request, or an empty string
+QString imageFormat(const QStringList &formats)
+{
+    if (formats.contains(PreferredImageFormat))
+        return PreferredImageFormat;
+
+    static const QList<QByteArray> supported = QImageReader::supportedMimeTypes();
+    for (const QString &format : formats) {
+        if (format.startsWith(QLatin1String("image/")) && supported.contains(format.toLatin1()))
+            return format;
+    }
+    return QString();
+}
+
+QImage readImage(QImageReader &reader)
+{
+    // Refuses images whose decoded size is absurd before allocating them
+    reader.setAllocationLimit(ClipboardCapture::DecodedImageLimitMB);
+    return reader.read();
+}
+
+QImage imageFromData(const QByteArray &data)
+{
+    QBuffer buffer;
+    buffer.setData(data);
+    buffer.open(QIODevice::ReadOnly);
+    QImageReader reader(&buffer);
+    return readImage(reader);
+}
+
+// A null image unless path is an image file within limit
+QImage imageFromFile(const QString &path, qint64 limit)
+{
+    // Even stat() can hang on a network mount, so this is the worker's job too
+    const QFileInfo info(path);
+    if (!info.isFile())
+        return QImage();
+    if (info.size() > limit) {
+        qWarning("Not reading %s (%lld bytes), over the size limit", qPrintable(path), info.size());
+        return QImage();
+    }
+    QImageReader reader(path);
+    return reader.canRead() ? readImage(reader) : QImage();
+}
+
+// The URLs of a text/uri-list (RFC 2483), skipping comments
+QList<QUrl> parseUriList(const QString &list)
+{
+    QList<QUrl> urls;
+    for (const QString &line : list.split(QLatin1Char('\n'), Qt::SkipEmptyParts)) {
+        const QString uri = line.trimmed();
+        if (!uri.isEmpty() && !uri.startsWith(QLatin1Char('#')))
+            urls.append(QUrl(uri));
+    }
+    return urls;
+}
+
+} // namespace
+
+ClipboardCapture::ClipboardCapture(QClipboard *clipboard, QObject *parent)
+    : QObject(parent)
+    , m_clipboard(clipboard)
+{
+    m_debounce.setSingleShot(true);
+    m_debounce.setInterval(DebounceMs);
+    connect(&m_debounce, &QTimer::timeout, this, &ClipboardCapture::capture);
+    connect(m_clipboard, &QClipboard::dataChanged, this, &ClipboardCapture::onDataChanged);
+
+    // A second worker keeps one slow decode from holding up the next copy
+    m_pool.setMaxThreadCount(2);
+}
+
+ClipboardCapture::~ClipboardCapture()
+{
+    if (m_cancel)
+        *m_cancel = true;
+    m_pool.clear();
+    m_pool.waitForDone();
+}
+
+void ClipboardCapture::setSizeLimit(Kind kind, qint64 bytes)
+{
+    m_limits[kind] = qMax<qint64>(0, bytes);
+}
+
+QStringList ClipboardCapture::imageFormats()
+{
+    QStringList formats { PreferredImageFormat };
+    for (const QByteArray &format : QImageReader::supportedMimeTypes()) {
+        if (format.startsWith("image/") && format != PreferredImageFormat.toLatin1())
+            formats.append(QString::fromLatin1(format));
+    }
+    return formats;
+}
+
+void ClipboardCapture::setWatchingClipboard(bool watching)
+{
+    m_watchingClipboard = watching;
+    disconnect(m_clipboard, &QClipboard::dataChanged, this, &ClipboardCapture::onDataChanged);
+    if (watching)
+        connect(m_clipboard, &QClipboard::dataChanged, this, &ClipboardCapture::onDataChanged);
+    else
+        m_debounce.stop();
+}
+
+void ClipboardCapture::onDataChanged()
+{
+    if (!m_debounce.isActive())
+        m_burstStart = Trace::now();
+    // Every notification restarts the timer, so a burst yields one capture
+    m_debounce.start();
+}
+
+ClipboardCapture::CancelToken ClipboardCapture::restart()
+{
+    // Whatever the previous capture is still doing is out of date now
+    if (m_cancel)
+        *m_cancel = true;
+    m_cancel = std::make_shared<std::atomic<bool>>(false);
+    return m_cancel;
+}
+
+void ClipboardCapture::capture()
+{
+    restart();
+
+    // Every mimeData() transfer below is a synchronous round trip to the
+    // owner on this thread. With the selections watched natively, the
+    // SelectionWatcher takes content and originals off the GUI thread.
+    if (!m_watchingClipboard)
+        return;
+
+    Trace::record(Trace::CaptureDebounce, m_burstStart, Trace::now());
+    Trace::Scope fetch(Trace::CaptureFetch);
+
+    const QMimeData *mimeData = m_clipboard->mimeData();
+    if (!mimeData)
+        return;
+
+    // Our own paste holds the entry's content already; it only moves up
+    if (const auto *entry = qobject_cast<const EntryMimeData *>(mimeData)) {
+        deliver(m_cancel, CapturedContent::known(entry->content(), entry->contentKey()), OriginalFormats::List(),
+                m_burstStart);
+        return;
+    }
+
+    // QClipboard tells no sizes before a transfer, so the limits are only
+    // checked on the data; SelectionWatcher checks them as it comes in.
+    // Each format is transferred once.
+    const QStringList formats = mimeData->formats();
+    OriginalFormats::List originals;
+    qint64 originalBytes = 0;
+    QByteArray uriList;
+    for (const QString &format : formats) {
+        if (!OriginalFormats::kept().contains(format) || originalBytes >= OriginalFormats::SizeLimit)
+            continue;
+        const QByteArray data = mimeData->data(format);
+        if (format == QLatin1String("text/uri-list"))
+            uriList = data;
+        if (data.isEmpty() || originalBytes + data.size() > OriginalFormats::SizeLimit)
+            continue;
+        originalBytes += data.size();
+        originals.append({ format, data });
+    }
+
+    QString text;
+    if (mimeData->hasText()) {
+        text = mimeData->text();
+        if (text.size() * qint64(sizeof(QChar)) > m_limits[Text]) {
+            qWarning("Skipping %lld characters of copied text, over the size limit", qint64(text.size()));
+            text.clear();
+        }
+    }
+
+    // 1. Raw image data (screenshots, "Copy Image"), decoded on the worker
+    const QString format = imageFormat(formats);
+    if (!format.isEmpty()) {
+        const QByteArray data = mimeData->data(format);
+        if (data.size() > m_limits[Image]) {
+            qWarning("Skipping a copied %s image of %lld bytes, over the size limit",
+                     qPrintable(format), qint64(data.size()));
+        } else if (!data.isEmpty()) {
+            decodeImage(data, text, originals);
+            return;
+        }
+    } else if (mimeData->hasImage()) {
+        // A QImage set in this process, nothing to transfer or decode
+        const QImage image = qvariant_cast<QImage>(mimeData->imageData());
+        if (!image.isNull()) {
+            prepare(image, originals);
+            return;
+        }
+    }
+
+    // 2. Image files (e.g. "Copy" in a file manager), read on the worker.
+    // The text is the fallback when the file turns out not to be an image.
+    if (!uriList.isEmpty() || mimeData->hasUrls()) {
+        const QList<QUrl> urls = uriList.isEmpty() ? mimeData->urls() : parseUriList(QString::fromUtf8(uriList));
+        if (!urls.isEmpty() && urls.first().isLocalFile()) {
+            decodeFile(urls.first().toLocalFile(), text, originals);
+            return;
+        }
+    }
+
+    // 3. Plain text
+    if (!text.isEmpty())
+        prepare(text, originals);
+}
+
+void ClipboardCapture::decodeImage(const QByteArray &data, const QString &fallbackText,
+                                   const OriginalFormats::List &originals)
+{
+    m_pool.start([this, token = m_cancel, data, fallbackText, originals, burstStart = m_burstStart]() {
+        if (*token)
+            return;
+        Trace::Scope decode(Trace::CaptureDecode);
+        const QImage image = imageFromData(data);
+        deliver(token, CapturedContent::prepare(image.isNull() ? QVariant(fallbackText) : QVariant(image)),
+                originals, burstStart);
+    });
+}
+
+void ClipboardCapture::decodeFile(const QString &path, const QString &fallbackText,
+                                  const OriginalFormats::List &originals)
+{
+    m_pool.start([this, token = m_cancel, path, fallbackText, originals, limit = m_limits[File],
+                  burstStart = m_burstStart]() {
+        if (*token)
+            return;
+        Trace::Scope decode(Trace::CaptureDecode);
+        const QImage image = imageFromFile(path, limit);
+        deliver(token, CapturedContent::prepare(image.isNull() ? QVariant(fallbackText) : QVariant(image)),
+                originals, burstStart);
+    });
+}
+
+void ClipboardCapture::captureSelection(SelectionWatcher::Selection selection, const QString &format,
+                                        const SelectionPayloadPtr &payload, const OriginalFormats::List &originals)
+{
+    Q_UNUSED(selection);
+    // The watcher has debounced and size-checked the transfer already
+    const CancelToken token = restart();
+    m_burstStart = Trace::now();
+
+    m_pool.start([this, token, format, payload, originals, fileLimit = m_limits[File], burstStart = m_burstStart]() {
+        if (*token)
+            return;
+        // No copy: the payload, possibly a mapped memfd, outlives this job.
+        // A text is still held twice once decoded: as the QString and as
+        // the UTF-8 prepared for the log. The fingerprint, label and search
+        // index need the decoded text, so it is not streamed from the memfd
+        // into the log; the size limits bound both copies.
+        const QByteArray data = QByteArray::fromRawData(payload->data(), payload->size());
+
+        QVariant content;
+        OriginalFormats::List offered = originals;
+        if (format.startsWith(QLatin1String("image/"))) {
+            Trace::Scope decode(Trace::CaptureDecode);
+            const QImage image = imageFromData(data);
+            if (!image.isNull())
+                content = image;
+        } else if (format == QLatin1String("text/uri-list")) {
+            // As with QClipboard: the first local file if it is an image,
+            // otherwise the list as text
+            const QList<QUrl> urls = parseUriList(QString::fromUtf8(data));
+            QStringList paths;
+            for (const QUrl &url : urls)
+                paths.append(url.isLocalFile() ? url.toLocalFile() : url.toString());
+            Trace::Scope decode(Trace::CaptureDecode);
+            const QImage image = !urls.isEmpty() && urls.first().isLocalFile()
+                ? imageFromFile(urls.first().toLocalFile(), fileLimit) : QImage();
+            content = image.isNull() ? QVariant(paths.join(QLatin1Char('\n'))) : QVariant(image);
+            // The list is an original format too, for pasting into a file manager
+            if (data.size() <= OriginalFormats::SizeLimit)
+                offered.prepend({ format, QByteArray(data.constData(), data.size()) });
+        } else if (format.endsWith(QLatin1String("iso-8859-1"))) {
+            content = QString::fromLatin1(data);
+        } else {
+            content = QString::fromUtf8(data);
+        }
+        deliver(token, CapturedContent::prepare(content), offered, burstStart);
+    });
+}
+
+void ClipboardCapture::prepare(const QVariant &content, const OriginalFormats::List &originals)
+{
+    m_pool.start([this, token = m_cancel, content, originals, burstStart = m_burstStart]() {
+        if (!*token)
+            deliver(token, CapturedContent::prepare(content), originals, burstStart);
+    });
+}
+
+void ClipboardCapture::deliver(const CancelToken &token, const CapturedContent &content,
+                               const OriginalFormats::List &originals, qint64 burstStart)
+{
+    if (*token || !content.content.isValid())
+        return;
+    if (content.content.typeId() == QMetaType::QString && content.content.toString().isEmpty())
+        return;
+
+    // Checked again on arrival: a newer capture may have started meanwhile
+    QMetaObject::invokeMethod(this, [this, token, content, originals, burstStart]() {
+        if (*token)
+            return;
+        emit captured(content, originals);
+        // Receivers are direct, so this includes adding the entry
+        Trace::record(Trace::CaptureTotal, burstStart, Trace::now());
+    }, Qt::QueuedConnection);
+}
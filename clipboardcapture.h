@@ -0,0 +1,94 @@
+#pragma once
+
+#include <QObject>
+#include <QThreadPool>
+#include <QTimer>
+#include <QVariant>
+
+#include "capturedcontent.h"
+#include "originalformats.h"
+#include "selectionwatcher.h"
+
+#include <atomic>
+#include <memory>
+
+class QClipboard;
+
+// Turns QClipboard::dataChanged() into history content without stalling
+// the GUI thread.
+//
+// Bursts of change notifications (terminals and IDEs send several per
+// copy) are coalesced: only the state DebounceMs after the last one is
+// captured. Only raw bytes are taken from the clipboard; decoding images,
+// reading files and preparing the content for the history (see
+// CapturedContent) happen on a worker. Each capture cancels the one
+// before it, whose result is then dropped.
+//
+// Payloads over the size limit of their kind are skipped with a warning
+// instead of being decoded. The OriginalFormats the source offered are
+// taken along with the content.
+//
+// When a SelectionWatcher transfers the selections natively, its payloads
+// come in through captureSelection() and QClipboard is no longer watched.
+class ClipboardCapture : public QObject
+{
+    Q_OBJECT
+
+public:
+    enum Kind {
+        Text,  // text/plain
+        Image, // image/* data, encoded
+        File,  // Image files referenced by text/uri-list
+        KindCount
+    };
+
+    static constexpr int DebounceMs = 50;
+    static constexpr qint64 DefaultTextLimit = 16LL * 1024 * 1024;
+    static constexpr qint64 DefaultImageLimit = 64LL * 1024 * 1024;
+    static constexpr qint64 DefaultFileLimit = 64LL * 1024 * 1024;
+    // Upper bound for a decoded image, whatever its encoded size
+    static constexpr int DecodedImageLimitMB = 512;
+
+    explicit ClipboardCapture(QClipboard *clipboard, QObject *parent = nullptr);
+    ~ClipboardCapture();
+
+    qint64 sizeLimit(Kind kind) const { return m_limits[kind]; }
+    void setSizeLimit(Kind kind, qint64 bytes);
+    void setDebounceInterval(int msec) { m_debounce.setInterval(msec); }
+    // The image MIME types the decoder reads, preferred first
+    static QStringList imageFormats();
+
+    // Whether QClipboard::dataChanged() triggers captures (the default)
+    void setWatchingClipboard(bool watching);
+
+public slots:
+    // A transfer finished by SelectionWatcher, decoded on the worker
+    void captureSelection(SelectionWatcher::Selection selection, const QString &format,
+                          const SelectionPayloadPtr &payload, const OriginalFormats::List &originals);
+
+signals:
+    // A QString or QImage, never empty or null, prepared for the history
+    // (only known by its fingerprint if it was pasted from it)
+    void captured(const CapturedContent &content, const OriginalFormats::List &originals);
+
+private:
+    using CancelToken = std::shared_ptr<std::atomic<bool>>;
+
+    void onDataChanged();
+    void capture();
+    CancelToken restart();
+    void decodeImage(const QByteArray &data, const QString &fallbackText, const OriginalFormats::List &originals);
+    void decodeFile(const QString &path, const QString &fallbackText, const OriginalFormats::List &originals);
+    // Prepares content found on the GUI thread on the worker, then delivers it
+    void prepare(const QVariant &content, const OriginalFormats::List &originals);
+    void deliver(const CancelToken &token, const CapturedContent &content, const OriginalFormats::List &originals,
+                 qint64 burstStart);
+
+    QClipboard *m_clipboard;
+    QTimer m_debounce;
+    QThreadPool m_pool;
+    CancelToken m_cancel;
+    qint64 m_burstStart = 0; // Trace::now() of the burst's first dataChanged()
+    qint64 m_limits[KindCount] = { DefaultTextLimit, DefaultImageLimit, DefaultFileLimit };
+    bool m_watchingClipboard = true;
+};
@@ -0,0 +1,147 @@
+#include "contenthash.h"
+
+#include <QImage>
+#include <QString>
+#include <QVariant>
+
+#include <cstring>
+
+namespace {
+
+constexpr quint64 Prime1 = 0x9E3779B185EBCA87ULL;
+constexpr quint64 Prime2 = 0xC2B2AE3D27D4EB4FULL;
+constexpr quint64 Prime3 = 0x165667B19E3779F9ULL;
+constexpr quint64 Prime4 = 0x85EBCA77C2B2AE63ULL;
+constexpr quint64 Prime5 = 0x27D4EB2F165667C5ULL;
+
+// Distinct seeds keep a text and an image with the same bytes apart
+constexpr quint64 TextSeed = 0x5445585400000001ULL;
+constexpr quint64 ImageSeed = 0x494d414700000002ULL;
+
+inline quint64 rotl(quint64 x, int r)
+{
+    return (x << r) | (x >> (64 - r));
+}
+
+inline quint64 read64(const uchar *p)
+{
+    quint64 v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+inline quint32 read32(const uchar *p)
+{
+    quint32 v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+inline quint64 round(quint64 acc, quint64 input)
+{
+    acc += input * Prime2;
+    acc = rotl(acc, 31);
+    return acc * Prime1;
+}
+
+inline quint64 mergeRound(quint64 acc, quint64 val)
+{
+    acc ^= round(0, val);
+    return acc * Prime1 + Prime4;
+}
+
+} // namespace
+
+namespace ContentHash {
+
+quint64 hash(const void *data, size_t length, quint64 seed)
+{
+    const uchar *p = static_cast<const uchar *>(data);
+    const uchar *const end = p + length;
+    quint64 h;
+
+    if (length >= 32) {
+        // The four lanes have no dependency on each other, so the
+        // compiler keeps them in flight together.
+        quint64 v1 = seed + Prime1 + Prime2;
+        quint64 v2 = seed + Prime2;
+        quint64 v3 = seed;
+        quint64 v4 = seed - Prime1;
+        const uchar *const limit = end - 32;
+        do {
+            v1 = round(v1, read64(p));
+            v2 = round(v2, read64(p + 8));
+            v3 = round(v3, read64(p + 16));
+            v4 = round(v4, read64(p + 24));
+            p += 32;
+        } while (p <= limit);
+
+        h = rotl(v1, 1) + rotl(v2, 7) + rotl(v3, 12) + rotl(v4, 18);
+        h = mergeRound(h, v1);
+        h = mergeRound(h, v2);
+        h = mergeRound(h, v3);
+        h = mergeRound(h, v4);
+    } else {
+        h = seed + Prime5;
+    }
+
+    h += quint64(length);
+
+    while (p + 8 <= end) {
+        h ^= round(0, read64(p));
+        h = rotl(h, 27) * Prime1 + Prime4;
+        p += 8;
+    }
+    if (p + 4 <= end) {
+        h ^= quint64(read32(p)) * Prime1;
+        h = rotl(h, 23) * Prime2 + Prime3;
+        p += 4;
+    }
+    while (p < end) {
+        h ^= quint64(*p) * Prime5;
+        h = rotl(h, 11) * Prime1;
+        ++p;
+    }
+
+    h ^= h >> 33;
+    h *= Prime2;
+    h ^= h >> 29;
+    h *= Prime3;
+    h ^= h >> 32;
+    return h;
+}
+
+quint64 ofText(const QString &text)
+{
+    return hash(text.constData(), size_t(text.size()) * sizeof(QChar), TextSeed);
+}
+
+quint64 ofImage(const QImage &image)
+{
+    quint64 h = ImageSeed;
+    const int header[3] = { image.width(), image.height(), int(image.format()) };
+    h = hash(header, sizeof(header), h);
+
+    // Row padding is not guaranteed to be initialized, so only hash it
+    // away in one pass when there is none.
+    const size_t rowBytes = (size_t(image.width()) * size_t(image.depth()) + 7) / 8;
+    if (rowBytes == size_t(image.bytesPerLine()))
+        return hash(image.constBits(), size_t(image.sizeInBytes()), h);
+    for (int y = 0; y < image.height(); ++y)
+        h = hash(image.constScanLine(y), rowBytes, h);
+    return h;
+}
+
+quint64 of(const QVariant &content)
+{
+    switch (content.typeId()) {
+    case QMetaType::QString:
+        return ofText(content.toString());
+    case QMetaType::QImage:
+        return ofImage(content.value<QImage>());
+    default:
+        return 0;
+    }
+}
+
+} // namespace ContentHash
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <QtGlobal>
+#include <cstddef>
+
+class QImage;
+class QString;
+class QVariant;
+
+// 64-bit content fingerprints for clipboard entries (XXH64: four
+// independent 64-bit lanes, several GB/s per core). Fingerprints are
+// stored on disk, so the algorithm and seeds must stay stable.
+namespace ContentHash {
+
+quint64 hash(const void *data, size_t length, quint64 seed = 0);
+
+quint64 ofText(const QString &text);
+// Covers size, format and the visible bytes of every row (not padding)
+quint64 ofImage(const QImage &image);
+// Dispatches on the QVariant type; 0 for anything else
+quint64 of(const QVariant &content);
+
+} // namespace ContentHash
@@ -0,0 +1,95 @@
+#include "controlclient.h"
+
+#include <QFile>
+#include <QJsonDocument>
+
+#include <cerrno>
+#include <cstring>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+using namespace ControlProtocol;
+
+ControlClient::~ControlClient()
+{
+    if (m_socket >= 0)
+        close(m_socket);
+}
+
+bool ControlClient::connectToServer(const QString &path)
+{
+    const QByteArray encoded = QFile::encodeName(path);
+    sockaddr_un address;
+    std::memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (encoded.isEmpty() || size_t(encoded.size()) >= sizeof(address.sun_path)) {
+        m_error = QString("Socket path is too long: %1").arg(path);
+        return false;
+    }
+    std::memcpy(address.sun_path, encoded.constData(), size_t(encoded.size()));
+
+    m_socket = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (m_socket < 0 || ::connect(m_socket, reinterpret_cast<const sockaddr *>(&address), sizeof(address)) < 0) {
+        m_error = QString("Cannot connect to %1: %2").arg(path, QString::fromLocal8Bit(strerror(errno)));
+        if (m_socket >= 0)
+            close(m_socket);
+        m_socket = -1;
+        return false;
+    }
+    return true;
+}
+
+bool ControlClient::call(const QJsonArray &requests, QJsonArray *responses, std::vector<int> *fds)
+{
+    Message request;
+    request.json = QJsonDocument(QJsonObject { { "requests", requests } }).toJson(QJsonDocument::Compact);
+    if (m_socket < 0 || !pack(&request) || ControlProtocol::send(m_socket, request) != Sent) {
+        m_error = QString("Cannot send the request: %1").arg(QString::fromLocal8Bit(strerror(errno)));
+        closeFds(&request);
+        return false;
+    }
+    closeFds(&request);
+
+    // Events may come first; the reply is the next message without one
+    for (;;) {
+        Message reply;
+        if (!receiveMessage(&reply))
+            return false;
+        const QJsonObject object = QJsonDocument::fromJson(reply.json).object();
+        if (object.contains("event")) {
+            m_events.append(object);
+            closeFds(&reply);
+            continue;
+        }
+        *responses = object.value("responses").toArray();
+        if (fds)
+            *fds = std::move(reply.fds);
+        else
+            closeFds(&reply);
+        return true;
+    }
+}
+
+bool ControlClient::nextEvent(QJsonObject *event)
+{
+    if (!m_events.isEmpty()) {
+        *event = m_events.takeFirst();
+        return true;
+    }
+    Message message;
+    if (!receiveMessage(&message))
+        return false;
+    closeFds(&message);
+    *event = QJsonDocument::fromJson(message.json).object();
+    return true;
+}
+
+bool ControlClient::receiveMessage(Message *message)
+{
+    if (m_socket >= 0 && ControlProtocol::receive(m_socket, message))
+        return true;
+    m_error = errno == 0 ? QStringLiteral("The server closed the connection")
+                         : QString("Cannot receive: %1").arg(QString::fromLocal8Bit(strerror(errno)));
+    return false;
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include "controlprotocol.h"
+
+#include <QJsonArray>
+#include <QJsonObject>
+#include <QList>
+#include <QString>
+
+// Blocking client for the control socket, for linclip-ctl and the
+// benchmarks. Not a QObject and needs no event loop.
+class ControlClient
+{
+public:
+    ControlClient() = default;
+    ~ControlClient();
+
+    bool connectToServer(const QString &path = ControlProtocol::socketPath());
+    QString errorString() const { return m_error; }
+
+    // Sends requests (at most MaxBatchSize) as one message and waits for
+    // the responses. The payload descriptors of the reply go to *fds, to
+    // be closed by the caller; without fds they are closed here.
+    bool call(const QJsonArray &requests, QJsonArray *responses, std::vector<int> *fds = nullptr);
+    // Waits for the next event after a subscribe request
+    bool nextEvent(QJsonObject *event);
+
+private:
+    bool receiveMessage(ControlProtocol::Message *message);
+
+    int m_socket = -1;
+    QString m_error;
+    // Events that arrived while waiting for responses
+    QList<QJsonObject> m_events;
+};
@@ -0,0 +1,204 @@
+#include "controlprotocol.h"
+
+#include <QStandardPaths>
+
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+// First byte of every datagram
+constexpr char InlineTag = 'J';
+constexpr char SpilledTag = 'P'; // The JSON is in the first descriptor
+
+bool writeAll(int fd, const char *data, qsizetype size)
+{
+    while (size > 0) {
+        const ssize_t written = write(fd, data, size_t(size));
+        if (written < 0) {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+        data += written;
+        size -= written;
+    }
+    return true;
+}
+
+} // namespace
+
+namespace ControlProtocol {
+
+QString socketPath()
+{
+    return QStandardPaths::writableLocation(QStandardPaths::RuntimeLocation) + QStringLiteral("/linclip.sock");
+}
+
+QString keyToString(quint64 key)
+{
+    return QString("%1").arg(key, 16, 16, QChar('0'));
+}
+
+quint64 keyFromString(const QString &key)
+{
+    bool ok = false;
+    const quint64 value = key.toULongLong(&ok, 16);
+    return ok ? value : 0;
+}
+
+int createPayload(const char *data, qsizetype size)
+{
+    const int fd = memfd_create("linclip-payload", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (fd < 0)
+        return -1;
+    // Sealed, so the receiver may map it without fearing SIGBUS or changes
+    if (!writeAll(fd, data, size)
+        || fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+qint64 payloadSize(int fd)
+{
+    struct stat info;
+    return fstat(fd, &info) == 0 ? qint64(info.st_size) : -1;
+}
+
+QByteArray readPayload(int fd)
+{
+    const qint64 size = payloadSize(fd);
+    if (size <= 0)
+        return QByteArray();
+    void *map = mmap(nullptr, size_t(size), PROT_READ, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED)
+        return QByteArray();
+    const QByteArray data(static_cast<const char *>(map), qsizetype(size));
+    munmap(map, size_t(size));
+    return data;
+}
+
+bool pack(Message *message)
+{
+    if (message->json.size() + 1 <= MaxMessageSize) {
+        message->json.prepend(InlineTag);
+        return true;
+    }
+    const int fd = createPayload(message->json.constData(), message->json.size());
+    if (fd < 0)
+        return false;
+    message->fds.insert(message->fds.begin(), fd);
+    message->json = QByteArray(1, SpilledTag);
+    return true;
+}
+
+SendResult send(int socket, const Message &message)
+{
+    iovec iov;
+    iov.iov_base = const_cast<char *>(message.json.constData());
+    iov.iov_len = size_t(message.json.size());
+
+    msghdr header;
+    std::memset(&header, 0, sizeof(header));
+    header.msg_iov = &iov;
+    header.msg_iovlen = 1;
+
+    // Aligned for cmsghdr, big enough for the most descriptors we send
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int) * MaxFds)];
+    if (!message.fds.empty()) {
+        if (message.fds.size() > size_t(MaxFds))
+            return Failed;
+        const size_t bytes = sizeof(int) * message.fds.size();
+        header.msg_control = control;
+        header.msg_controllen = CMSG_SPACE(bytes);
+        cmsghdr *cmsg = CMSG_FIRSTHDR(&header);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(bytes);
+        std::memcpy(CMSG_DATA(cmsg), message.fds.data(), bytes);
+    }
+
+    for (;;) {
+        if (sendmsg(socket, &header, MSG_NOSIGNAL) >= 0)
+            return Sent;
+        if (errno == EINTR)
+            continue;
+        return (errno == EAGAIN || errno == EWOULDBLOCK) ? WouldBlock : Failed;
+    }
+}
+
+bool receive(int socket, Message *message)
+{
+    closeFds(message);
+    message->json.resize(MaxMessageSize);
+
+    iovec iov;
+    iov.iov_base = message->json.data();
+    iov.iov_len = size_t(message->json.size());
+
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int) * MaxFds)];
+    msghdr header;
+    std::memset(&header, 0, sizeof(header));
+    header.msg_iov = &iov;
+    header.msg_iovlen = 1;
+    header.msg_control = control;
+    header.msg_controllen = sizeof(control);
+
+    ssize_t received;
+    do {
+        received = recvmsg(socket, &header, MSG_CMSG_CLOEXEC);
+    } while (received < 0 && errno == EINTR);
+    if (received <= 0) {
+        if (received == 0)
+            errno = 0; // EOF
+        message->json.clear();
+        return false;
+    }
+    message->json.resize(received);
+
+    for (cmsghdr *cmsg = CMSG_FIRSTHDR(&header); cmsg; cmsg = CMSG_NXTHDR(&header, cmsg)) {
+        if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS)
+            continue;
+        const size_t count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+        const size_t first = message->fds.size();
+        message->fds.resize(first + count);
+        std::memcpy(message->fds.data() + first, CMSG_DATA(cmsg), count * sizeof(int));
+    }
+
+    // Truncated messages would misattribute descriptors; refuse them whole
+    if (header.msg_flags & (MSG_TRUNC | MSG_CTRUNC)) {
+        closeFds(message);
+        errno = EMSGSIZE;
+        return false;
+    }
+
+    if (message->json.startsWith(SpilledTag) && !message->fds.empty()) {
+        const int fd = message->fds.front();
+        message->fds.erase(message->fds.begin());
+        message->json = readPayload(fd);
+        close(fd);
+    } else if (message->json.startsWith(InlineTag)) {
+        message->json.remove(0, 1);
+    } else {
+        closeFds(message);
+        errno = EPROTO;
+        return false;
+    }
+    return true;
+}
+
+void closeFds(Message *message)
+{
+    for (int fd : message->fds)
+        close(fd);
+    message->fds.clear();
+}
+
+} // namespace ControlProtocol
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <QByteArray>
+#include <QString>
+
+#include <vector>
+
+// Wire format of the local control socket, shared by ControlServer in the
+// application and by ControlClient (linclip-ctl, the benchmarks).
+//
+// The socket is AF_UNIX SOCK_SEQPACKET, so message boundaries are kept by
+// the kernel and file descriptors travel with the message they belong to.
+// A message is one JSON document. A client sends a batch:
+//
+//   { "requests": [ { "op": "list", "from": 0, "count": 50 }, ... ] }
+//
+// and gets one message back with a response per request, in order:
+//
+//   { "responses": [ { "entries": [...], "total": 1234 }, ... ] }
+//
+// Operations:
+//   list      from, count (at most MaxListCount) -> entries, total
+//   search    query, limit                       -> entries
+//   get       key                                -> type, bytes, and text or fd
+//   activate  key                                -> (empty); pastes the entry
+//   subscribe                                    -> (empty); then events
+//
+// An entry is { "key", "type": "text"|"image", "label", "lines", "bytes" };
+// keys are the history's content fingerprints as 16 hex digits. A failed
+// request gets { "error": "..." } instead.
+//
+// Payloads up to InlinePayloadLimit travel in the JSON as "text". Larger
+// ones and all images (as PNG) are handed over as a sealed memfd; "fd" is
+// its index in the message's descriptors. After subscribe, the server sends
+// { "event": "added", "entry": {...} } whenever an entry comes to the front.
+namespace ControlProtocol {
+
+constexpr qsizetype MaxMessageSize = 64 * 1024;
+constexpr int MaxBatchSize = 64;
+constexpr int MaxListCount = 1000;
+constexpr qsizetype InlinePayloadLimit = 4096;
+// One payload per request in a batch, plus a spilled message
+constexpr int MaxFds = MaxBatchSize + 1;
+
+struct Message {
+    QByteArray json;
+    std::vector<int> fds; // Owned by the message until handed on
+};
+
+enum SendResult {
+    Sent,
+    WouldBlock, // Non-blocking socket is full; send again later
+    Failed
+};
+
+// $XDG_RUNTIME_DIR/linclip.sock
+QString socketPath();
+
+QString keyToString(quint64 key);
+quint64 keyFromString(const QString &key); // 0 if invalid
+
+// A sealed anonymous file holding data; -1 on failure
+int createPayload(const char *data, qsizetype size);
+// Size of a payload fd, or -1
+qint64 payloadSize(int fd);
+// The whole content of a payload fd
+QByteArray readPayload(int fd);
+
+// Moves JSON too large for one datagram into a payload fd of its own.
+// Call once before send().
+bool pack(Message *message);
+SendResult send(int socket, const Message &message);
+// One message, unpacked. False on EOF (errno 0) or error; errno is EAGAIN
+// on a non-blocking socket with nothing pending.
+bool receive(int socket, Message *message);
+
+void closeFds(Message *message);
+
+} // namespace ControlProtocol
@@ -0,0 +1,399 @@
+#include "controlserver.h"
+#include "historymodel.h"
+#include "searchindex.h"
+
+#include <QBuffer>
+#include <QFile>
+#include <QImage>
+#include <QJsonDocument>
+#include <QSocketNotifier>
+
+#include <cerrno>
+#include <cstring>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+using namespace ControlProtocol;
+
+namespace {
+
+QJsonObject errorResponse(const QString &message)
+{
+    return QJsonObject { { "error", message } };
+}
+
+bool socketAddress(const QString &path, sockaddr_un *address)
+{
+    const QByteArray encoded = QFile::encodeName(path);
+    std::memset(address, 0, sizeof(*address));
+    address->sun_family = AF_UNIX;
+    if (encoded.isEmpty() || size_t(encoded.size()) >= sizeof(address->sun_path))
+        return false;
+    std::memcpy(address->sun_path, encoded.constData(), size_t(encoded.size()));
+    return true;
+}
+
+} // namespace
+
+ControlServer::ControlServer(HistoryModel *model, QObject *parent)
+    : QObject(parent)
+    , m_model(model)
+{
+    connect(m_model, &HistoryModel::entryPrepended, this, &ControlServer::onEntryPrepended);
+    // Searches in flight use the model's index. It is a child of the model,
+    // so it is still there while the model's destroyed() is emitted.
+    connect(m_model, &QObject::destroyed, this, [this]() {
+        m_pool.clear();
+        m_pool.waitForDone();
+        m_model = nullptr;
+    });
+}
+
+ControlServer::~ControlServer()
+{
+    m_pool.clear();
+    m_pool.waitForDone();
+    const QList<quint64> clients = m_clients.keys();
+    for (quint64 clientId : clients)
+        disconnectClient(clientId);
+    if (m_socket >= 0) {
+        close(m_socket);
+        unlink(QFile::encodeName(m_path).constData());
+    }
+}
+
+bool ControlServer::listen(const QString &path)
+{
+    sockaddr_un address;
+    if (!socketAddress(path, &address)) {
+        qWarning("Control socket path is too long: %s", qPrintable(path));
+        return false;
+    }
+
+    m_socket = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+    if (m_socket < 0) {
+        qWarning("Cannot create the control socket: %s", strerror(errno));
+        return false;
+    }
+
+    auto *addr = reinterpret_cast<const sockaddr *>(&address);
+    int bound = bind(m_socket, addr, sizeof(address));
+    if (bound < 0 && errno == EADDRINUSE) {
+        // Left behind by a crash, unless another instance still answers
+        const int probe = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+        const bool inUse = probe >= 0 && ::connect(probe, addr, sizeof(address)) == 0;
+        if (probe >= 0)
+            close(probe);
+        if (inUse) {
+            qWarning("Another instance is listening on %s", qPrintable(path));
+            close(m_socket);
+            m_socket = -1;
+            return false;
+        }
+        unlink(address.sun_path);
+        bound = bind(m_socket, addr, sizeof(address));
+    }
+    if (bound < 0 || chmod(address.sun_path, 0600) < 0 || ::listen(m_socket, SOMAXCONN) < 0) {
+        qWarning("Cannot listen on %s: %s", qPrintable(path), strerror(errno));
+        close(m_socket);
+        m_socket = -1;
+        return false;
+    }
+
+    m_path = path;
+    m_listenNotifier = new QSocketNotifier(m_socket, QSocketNotifier::Read, this);
+    connect(m_listenNotifier, &QSocketNotifier::activated, this, &ControlServer::onNewConnection);
+    return true;
+}
+
+void ControlServer::onNewConnection()
+{
+    for (;;) {
+        const int socket = accept4(m_socket, nullptr, nullptr, SOCK_CLOEXEC | SOCK_NONBLOCK);
+        if (socket < 0) {
+            if (errno == EINTR)
+                continue;
+            return; // EAGAIN: all taken
+        }
+
+        // The socket file is private already; this also covers a moved one
+        ucred credentials;
+        socklen_t length = sizeof(credentials);
+        if (getsockopt(socket, SOL_SOCKET, SO_PEERCRED, &credentials, &length) < 0
+            || credentials.uid != getuid()) {
+            close(socket);
+            continue;
+        }
+
+        const quint64 clientId = m_nextClientId++;
+        auto *client = new Client;
+        client->socket = socket;
+        client->readNotifier = new QSocketNotifier(socket, QSocketNotifier::Read, this);
+        client->writeNotifier = new QSocketNotifier(socket, QSocketNotifier::Write, this);
+        client->writeNotifier->setEnabled(false);
+        connect(client->readNotifier, &QSocketNotifier::activated, this, [this, clientId]() { onReadable(clientId); });
+        connect(client->writeNotifier, &QSocketNotifier::activated, this, [this, clientId]() { onWritable(clientId); });
+        m_clients.insert(clientId, client);
+    }
+}
+
+void ControlServer::onReadable(quint64 clientId)
+{
+    for (;;) {
+        const Client *client = m_clients.value(clientId);
+        if (!client)
+            return;
+        Message message;
+        if (!receive(client->socket, &message)) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK)
+                disconnectClient(clientId); // EOF or a broken message
+            return;
+        }
+        // Requests carry no descriptors
+        closeFds(&message);
+        handleRequests(clientId, message.json);
+    }
+}
+
+void ControlServer::onWritable(quint64 clientId)
+{
+    flush(clientId);
+}
+
+void ControlServer::onEntryPrepended(quint64 contentKey)
+{
+    QList<quint64> subscribers;
+    for (auto it = m_clients.cbegin(); it != m_clients.cend(); ++it) {
+        if (it.value()->subscribed)
+            subscribers.append(it.key());
+    }
+    if (subscribers.isEmpty())
+        return;
+
+    const QJsonObject event { { "event", "added" }, { "entry", entryObject(m_model->rowForKey(contentKey)) } };
+    const QByteArray json = QJsonDocument(event).toJson(QJsonDocument::Compact);
+    for (quint64 clientId : subscribers)
+        send(clientId, Message { json, {} });
+}
+
+void ControlServer::handleRequests(quint64 clientId, const QByteArray &json)
+{
+    if (!m_model)
+        return;
+    auto batch = std::make_shared<Batch>();
+    batch->client = clientId;
+
+    const QJsonDocument document = QJsonDocument::fromJson(json);
+    const QJsonArray requests = document.object().value("requests").toArray();
+    if (requests.isEmpty() || requests.size() > MaxBatchSize) {
+        batch->responses.append(errorResponse(QString("Expected 1 to %1 requests").arg(MaxBatchSize)));
+        sendBatch(batch);
+        return;
+    }
+
+    // Held until every request has been started, so that one finishing
+    // right away cannot send the batch early
+    batch->pending = 1;
+    for (int i = 0; i < requests.size(); ++i)
+        batch->responses.append(handleRequest(batch, i, requests.at(i).toObject()));
+    if (--batch->pending == 0)
+        sendBatch(batch);
+}
+
+QJsonObject ControlServer::handleRequest(const BatchPtr &batch, int index, const QJsonObject &request)
+{
+    const QString op = request.value("op").toString();
+
+    if (op == "list") {
+        const int total = m_model->rowCount();
+        const int from = qBound(0, request.value("from").toInt(0), total);
+        const int count = qBound(0, request.value("count").toInt(MaxListCount), MaxListCount);
+        QJsonArray entries;
+        for (int row = from; row < qMin(total, from + count); ++row)
+            entries.append(entryObject(row));
+        return QJsonObject { { "entries", entries }, { "total", total } };
+    }
+
+    if (op == "search") {
+        const QString query = request.value("query").toString();
+        const int limit = qBound(1, request.value("limit").toInt(DefaultSearchLimit), MaxListCount);
+        ++batch->pending;
+        m_pool.start([this, batch, index, query, limit, search = m_model->searchIndex()]() {
+            const QList<quint64> keys = search->query(query, limit);
+            QMetaObject::invokeMethod(this, [this, batch, index, keys]() {
+                if (!m_model)
+                    return;
+                // Rows are looked up now; entries evicted meanwhile are left out
+                QJsonArray entries;
+                for (quint64 key : keys) {
+                    const int row = m_model->rowForKey(key);
+                    if (row >= 0)
+                        entries.append(entryObject(row));
+                }
+                finishRequest(batch, index, QJsonObject { { "entries", entries } }, -1);
+            }, Qt::QueuedConnection);
+        });
+        return QJsonObject();
+    }
+
+    if (op == "subscribe") {
+        if (Client *client = m_clients.value(batch->client))
+            client->subscribed = true;
+        return QJsonObject();
+    }
+
+    if (op != "get" && op != "activate")
+        return errorResponse(QString("Unknown op \"%1\"").arg(op));
+
+    const int row = m_model->rowForKey(keyFromString(request.value("key").toString()));
+    if (row < 0)
+        return errorResponse(QStringLiteral("No such entry"));
+    if (op == "activate") {
+        emit activateRequested(row);
+        return QJsonObject();
+    }
+    return getEntry(batch, index, row);
+}
+
+QJsonObject ControlServer::getEntry(const BatchPtr &batch, int index, int row)
+{
+    const HistoryModel::EntryInfo info = m_model->entryInfo(row);
+    QJsonObject response { { "key", keyToString(info.contentKey) } };
+
+    if (!info.image) {
+        const QByteArray utf8 = m_model->utf8TextAt(row);
+        response["type"] = "text";
+        response["bytes"] = utf8.size();
+        if (utf8.size() <= InlinePayloadLimit) {
+            response["text"] = QString::fromUtf8(utf8);
+            return response;
+        }
+        const int fd = createPayload(utf8.constData(), utf8.size());
+        if (fd < 0)
+            return errorResponse(QString("Cannot create a payload: %1").arg(strerror(errno)));
+        response["fd"] = int(batch->fds.size());
+        batch->fds.push_back(fd);
+        return response;
+    }
+
+    // Decoding and assembling a large image is as slow as encoding it, so
+    // both are left to the pool
+    response["type"] = "image";
+    response["format"] = "image/png";
+    ++batch->pending;
+    m_pool.start([this, batch, index, load = m_model->imageLoaderAt(row), response]() mutable {
+        const QImage image = load();
+        QByteArray png;
+        if (!image.isNull()) {
+            QBuffer buffer(&png);
+            buffer.open(QIODevice::WriteOnly);
+            image.save(&buffer, "PNG");
+        }
+        const int fd = png.isEmpty() ? -1 : createPayload(png.constData(), png.size());
+        if (image.isNull())
+            response = errorResponse(QStringLiteral("Cannot read the image"));
+        else if (fd < 0)
+            response = errorResponse(QStringLiteral("Cannot encode the image"));
+        else
+            response["bytes"] = png.size();
+        QMetaObject::invokeMethod(this, [this, batch, index, response, fd]() {
+            finishRequest(batch, index, response, fd);
+        }, Qt::QueuedConnection);
+    });
+    return QJsonObject();
+}
+
+void ControlServer::finishRequest(const BatchPtr &batch, int index, QJsonObject response, int fd)
+{
+    if (fd >= 0) {
+        response["fd"] = int(batch->fds.size());
+        batch->fds.push_back(fd);
+    }
+    batch->responses[index] = response;
+    if (--batch->pending == 0)
+        sendBatch(batch);
+}
+
+void ControlServer::sendBatch(const BatchPtr &batch)
+{
+    Message message;
+    message.json = QJsonDocument(QJsonObject { { "responses", batch->responses } }).toJson(QJsonDocument::Compact);
+    message.fds = std::move(batch->fds);
+    batch->fds.clear();
+    send(batch->client, std::move(message));
+}
+
+QJsonObject ControlServer::entryObject(int row) const
+{
+    if (row < 0)
+        return QJsonObject();
+    const HistoryModel::EntryInfo info = m_model->entryInfo(row);
+    QJsonObject entry {
+        { "key", keyToString(info.contentKey) },
+        { "type", info.image ? "image" : "text" },
+        { "label", info.label },
+        { "bytes", info.bytes },
+    };
+    if (!info.image)
+        entry["lines"] = qint64(info.lineCount);
+    return entry;
+}
+
+void ControlServer::send(quint64 clientId, Message message)
+{
+    Client *client = m_clients.value(clientId);
+    if (!client || !pack(&message)) {
+        closeFds(&message);
+        return;
+    }
+    if (int(client->outbox.size()) >= MaxQueuedMessages) {
+        qWarning("Dropping a control client that stopped reading");
+        closeFds(&message);
+        disconnectClient(clientId);
+        return;
+    }
+    client->outbox.push_back(std::move(message));
+    flush(clientId);
+}
+
+bool ControlServer::flush(quint64 clientId)
+{
+    Client *client = m_clients.value(clientId);
+    if (!client)
+        return false;
+    while (!client->outbox.empty()) {
+        switch (ControlProtocol::send(client->socket, client->outbox.front())) {
+        case Sent:
+            // The receiver has its own copies of the descriptors now
+            closeFds(&client->outbox.front());
+            client->outbox.pop_front();
+            break;
+        case WouldBlock:
+            client->writeNotifier->setEnabled(true);
+            return true;
+        case Failed:
+            disconnectClient(clientId);
+            return false;
+        }
+    }
+    client->writeNotifier->setEnabled(false);
+    return true;
+}
+
+void ControlServer::disconnectClient(quint64 clientId)
+{
+    Client *client = m_clients.take(clientId);
+    if (!client)
+        return;
+    // May be called from the notifiers' own signals
+    client->readNotifier->setEnabled(false);
+    client->writeNotifier->setEnabled(false);
+    client->readNotifier->deleteLater();
+    client->writeNotifier->deleteLater();
+    close(client->socket);
+    for (Message &message : client->outbox)
+        closeFds(&message);
+    delete client;
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include "controlprotocol.h"
+
+#include <QHash>
+#include <QJsonArray>
+#include <QJsonObject>
+#include <QObject>
+#include <QThreadPool>
+
+#include <deque>
+#include <memory>
+
+class HistoryModel;
+class QSocketNotifier;
+
+// Serves the history to local scripts over the control socket; see
+// ControlProtocol for the messages.
+//
+// Lives on the GUI thread next to the model, driven by QSocketNotifiers on
+// non-blocking sockets. Only searching and PNG encoding go to a worker; a
+// batch is answered once all of its requests are done. Replies a slow
+// client cannot take yet are queued, up to MaxQueuedMessages.
+class ControlServer : public QObject
+{
+    Q_OBJECT
+
+public:
+    static constexpr int MaxQueuedMessages = 256;
+    static constexpr int DefaultSearchLimit = 50;
+
+    explicit ControlServer(HistoryModel *model, QObject *parent = nullptr);
+    ~ControlServer();
+
+    // Refuses to take over a socket another instance is listening on
+    bool listen(const QString &path = ControlProtocol::socketPath());
+    QString path() const { return m_path; }
+
+signals:
+    // An activate request; the receiver puts row on the clipboard
+    void activateRequested(int row);
+
+private:
+    struct Client {
+        int socket = -1;
+        QSocketNotifier *readNotifier = nullptr;
+        QSocketNotifier *writeNotifier = nullptr;
+        std::deque<ControlProtocol::Message> outbox;
+        bool subscribed = false;
+    };
+
+    // The responses to one request message, filled in as they finish
+    struct Batch {
+        quint64 client = 0;
+        QJsonArray responses;
+        std::vector<int> fds;
+        int pending = 0;
+    };
+    using BatchPtr = std::shared_ptr<Batch>;
+
+    void onNewConnection();
+    void onReadable(quint64 clientId);
+    void onWritable(quint64 clientId);
+    void onEntryPrepended(quint64 contentKey);
+
+    void handleRequests(quint64 clientId, const QByteArray &json);
+    QJsonObject handleRequest(const BatchPtr &batch, int index, const QJsonObject &request);
+    QJsonObject getEntry(const BatchPtr &batch, int index, int row);
+    // Completes an asynchronous request; fd (or -1) goes to the response
+    void finishRequest(const BatchPtr &batch, int index, QJsonObject response, int fd);
+    void sendBatch(const BatchPtr &batch);
+
+    QJsonObject entryObject(int row) const;
+    void send(quint64 clientId, ControlProtocol::Message message);
+    // False once the client is gone
+    bool flush(quint64 clientId);
+    void disconnectClient(quint64 clientId);
+
+    HistoryModel *m_model;
+    int m_socket = -1;
+    QString m_path;
+    QSocketNotifier *m_listenNotifier = nullptr;
+    QHash<quint64, Client *> m_clients;
+    quint64 m_nextClientId = 1;
+    QThreadPool m_pool;
+};
@@ -0,0 +1,21 @@
+# linclip-ctl: scripts' access to a running LinClip over the control socket.
+# Built by ClipboardManager.pro, or on its own with qmake ctl/ctl.pro; see
+# the README for the commands.
+
+QT = core
+
+CONFIG += c++17 console
+CONFIG -= app_bundle
+
+TARGET = linclip-ctl
+
+INCLUDEPATH += $$PWD/..
+
+SOURCES += \
+    main.cpp \
+    $$PWD/../controlclient.cpp \
+    $$PWD/../controlprotocol.cpp
+
+HEADERS += \
+    $$PWD/../controlclient.h \
+    $$PWD/../controlprotocol.h
@@ -0,0 +1,168 @@
+#include "controlclient.h"
+
+#include <QCoreApplication>
+#include <QJsonDocument>
+#include <QStringList>
+#include <QTextStream>
+
+#include <cerrno>
+#include <cstdio>
+#include <sys/sendfile.h>
+#include <unistd.h>
+
+namespace {
+
+const char Usage[] =
+    "Usage: linclip-ctl [--socket PATH] COMMAND\n"
+    "\n"
+    "  list [FROM [COUNT]]   Key, type, size and label of entries, newest first\n"
+    "  search QUERY [LIMIT]  The same for the best matches of QUERY\n"
+    "  get KEY               Writes an entry to stdout: text as UTF-8, images as PNG\n"
+    "  activate KEY          Puts an entry on the clipboard\n"
+    "  watch                 Prints entries as they come to the front\n"
+    "  batch                 Sends the requests on stdin, one JSON object per line,\n"
+    "                        and prints a response per line\n";
+
+int fail(const QString &message)
+{
+    QTextStream(stderr) << "linclip-ctl: " << message << Qt::endl;
+    return 1;
+}
+
+void printEntry(QTextStream &out, const QJsonObject &entry)
+{
+    QString label = entry.value("label").toString();
+    label.replace('\t', ' ');
+    out << entry.value("key").toString() << '\t' << entry.value("type").toString() << '\t'
+        << qint64(entry.value("bytes").toDouble()) << '\t' << label << '\n';
+}
+
+// Without a copy through this process where the kernel allows it
+bool writePayload(int fd)
+{
+    const qint64 size = ControlProtocol::payloadSize(fd);
+    off_t offset = 0;
+    while (offset < size) {
+        const ssize_t sent = sendfile(STDOUT_FILENO, fd, &offset, size_t(size - offset));
+        if (sent < 0 && errno == EINTR)
+            continue;
+        if (sent <= 0)
+            break;
+    }
+    if (offset == size)
+        return true;
+    // Not a descriptor sendfile() writes to
+    const QByteArray data = ControlProtocol::readPayload(fd).mid(offset);
+    return fwrite(data.constData(), 1, size_t(data.size()), stdout) == size_t(data.size());
+}
+
+// Reads requests from stdin and sends them in batches as large as allowed
+int runBatch(ControlClient &client, QTextStream &out)
+{
+    QTextStream in(stdin);
+    QJsonArray requests;
+    auto flush = [&]() {
+        QJsonArray responses;
+        if (!client.call(requests, &responses))
+            return false;
+        for (const QJsonValue &response : responses)
+            out << QJsonDocument(response.toObject()).toJson(QJsonDocument::Compact) << '\n';
+        out.flush();
+        requests = QJsonArray();
+        return true;
+    };
+
+    QString line;
+    while (in.readLineInto(&line)) {
+        if (line.trimmed().isEmpty())
+            continue;
+        requests.append(QJsonDocument::fromJson(line.toUtf8()).object());
+        if (requests.size() == ControlProtocol::MaxBatchSize && !flush())
+            return fail(client.errorString());
+    }
+    if (!requests.isEmpty() && !flush())
+        return fail(client.errorString());
+    return 0;
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QStringList args = app.arguments().mid(1);
+
+    QString socketPath = ControlProtocol::socketPath();
+    if (args.size() >= 2 && args.first() == "--socket") {
+        socketPath = args.at(1);
+        args = args.mid(2);
+    }
+    if (args.isEmpty() || args.first() == "--help" || args.first() == "-h") {
+        fputs(Usage, args.isEmpty() ? stderr : stdout);
+        return args.isEmpty() ? 2 : 0;
+    }
+
+    ControlClient client;
+    if (!client.connectToServer(socketPath))
+        return fail(client.errorString() + "\nIs LinClip running?");
+
+    QTextStream out(stdout);
+    const QString command = args.takeFirst();
+
+    if (command == "batch")
+        return runBatch(client, out);
+
+    QJsonObject request;
+    if (command == "list") {
+        request = { { "op", "list" }, { "from", args.value(0, "0").toInt() } };
+        if (args.size() > 1)
+            request["count"] = args.at(1).toInt();
+    } else if (command == "search" && !args.isEmpty()) {
+        request = { { "op", "search" }, { "query", args.at(0) } };
+        if (args.size() > 1)
+            request["limit"] = args.at(1).toInt();
+    } else if ((command == "get" || command == "activate") && args.size() == 1) {
+        request = { { "op", command }, { "key", args.at(0) } };
+    } else if (command == "watch") {
+        request = { { "op", "subscribe" } };
+    } else {
+        fputs(Usage, stderr);
+        return 2;
+    }
+
+    QJsonArray responses;
+    std::vector<int> fds;
+    if (!client.call(QJsonArray { request }, &responses, &fds))
+        return fail(client.errorString());
+    const QJsonObject response = responses.at(0).toObject();
+    if (response.contains("error")) {
+        for (int fd : fds)
+            close(fd);
+        return fail(response.value("error").toString());
+    }
+
+    int status = 0;
+    if (command == "list" || command == "search") {
+        for (const QJsonValue &entry : response.value("entries").toArray())
+            printEntry(out, entry.toObject());
+    } else if (command == "get") {
+        const int index = response.value("fd").toInt(-1);
+        if (index >= 0 && index < int(fds.size())) {
+            if (!writePayload(fds.at(size_t(index))))
+                status = fail(QStringLiteral("Cannot write the entry"));
+        } else {
+            out << response.value("text").toString();
+        }
+    } else if (command == "watch") {
+        QJsonObject event;
+        while (client.nextEvent(&event)) {
+            printEntry(out, event.value("entry").toObject());
+            out.flush();
+        }
+        status = fail(client.errorString());
+    }
+
+    for (int fd : fds)
+        close(fd);
+    return status;
+}
@@ -0,0 +1,122 @@
+#include "encodedcache.h"
+#include "trace.h"
+
+#include <QBuffer>
+#include <QImage>
+#include <QImageWriter>
+#include <QMutexLocker>
+
+#include <utility>
+
+EncodedCache::EncodedCache(qsizetype budgetBytes)
+    : m_encoded(budgetBytes)
+{
+    // One encoding per type being pasted is plenty
+    m_pool.setMaxThreadCount(2);
+}
+
+EncodedCache::~EncodedCache()
+{
+    m_pool.clear();
+    m_pool.waitForDone();
+}
+
+void EncodedCache::prefetch(quint64 key, const QString &mimeType, const QVariant &content)
+{
+    QMutexLocker locker(&m_mutex);
+    const Key cacheKey(key, mimeType);
+    if (!m_pending.contains(cacheKey) && !m_encoded.contains(cacheKey))
+        start(cacheKey, content);
+}
+
+QByteArray EncodedCache::encoded(quint64 key, const QString &mimeType, const QVariant &content)
+{
+    QMutexLocker locker(&m_mutex);
+    const Key cacheKey(key, mimeType);
+    if (!m_pending.contains(cacheKey) && !m_encoded.contains(cacheKey))
+        start(cacheKey, content);
+    while (m_pending.contains(cacheKey))
+        m_finished.wait(&m_mutex);
+
+    if (const QByteArray *data = m_encoded.object(cacheKey))
+        return *data;
+    if (m_oversizedKey == cacheKey) {
+        m_oversizedKey = Key();
+        return std::exchange(m_oversized, QByteArray());
+    }
+    return QByteArray();
+}
+
+void EncodedCache::start(const Key &key, const QVariant &content)
+{
+    m_pending.insert(key);
+    m_pool.start([this, key, content]() {
+        const qint64 started = Trace::now();
+        const QByteArray data = encode(content, key.second);
+        Trace::record(Trace::PasteEncode, started, Trace::now(), data.size());
+
+        QMutexLocker locker(&m_mutex);
+        // clear() may have dropped the request in the meantime
+        if (m_pending.remove(key) && !data.isEmpty()) {
+            const qsizetype cost = qMax<qsizetype>(1, data.size());
+            if (cost <= m_encoded.maxCost()) {
+                m_encoded.insert(key, new QByteArray(data), cost);
+            } else {
+                m_oversizedKey = key;
+                m_oversized = data;
+            }
+        }
+        m_finished.wakeAll();
+    });
+}
+
+void EncodedCache::clear()
+{
+    QMutexLocker locker(&m_mutex);
+    m_encoded.clear();
+    m_pending.clear();
+    m_oversizedKey = Key();
+    m_oversized.clear();
+    // Anyone waiting gets an empty result rather than a stale one
+    m_finished.wakeAll();
+}
+
+qsizetype EncodedCache::encodedBytes() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_encoded.totalCost();
+}
+
+QStringList EncodedCache::imageFormats()
+{
+    static const QStringList formats = []() {
+        QStringList result { QStringLiteral("image/png") };
+        for (const QByteArray &format : QImageWriter::supportedMimeTypes()) {
+            if (format.startsWith("image/") && format != "image/png")
+                result.append(QString::fromLatin1(format));
+        }
+        return result;
+    }();
+    return formats;
+}
+
+QByteArray EncodedCache::encode(const QVariant &content, const QString &mimeType)
+{
+    if (content.typeId() != QMetaType::QImage) {
+        if (!mimeType.startsWith(QLatin1String("text/plain")))
+            return QByteArray();
+        return mimeType.endsWith(QLatin1String("iso-8859-1")) ? content.toString().toLatin1()
+                                                            : content.toString().toUtf8();
+    }
+
+    const QList<QByteArray> writers = QImageWriter::imageFormatsForMimeType(mimeType.toLatin1());
+    if (writers.isEmpty())
+        return QByteArray();
+    QByteArray data;
+    QBuffer buffer(&data);
+    buffer.open(QIODevice::WriteOnly);
+    QImageWriter writer(&buffer, writers.first());
+    if (!writer.write(content.value<QImage>()))
+        return QByteArray();
+    return data;
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <QByteArray>
+#include <QCache>
+#include <QMutex>
+#include <QPair>
+#include <QSet>
+#include <QString>
+#include <QStringList>
+#include <QThreadPool>
+#include <QVariant>
+#include <QWaitCondition>
+
+// Thread-safe LRU of entries encoded for the MIME types pasting asks for
+// (image/png, image/bmp, text/plain ...), keyed by content fingerprint and
+// type and bounded by a byte budget.
+//
+// Encoding always runs on a worker. prefetch() starts it ahead of time;
+// encoded() waits for it, so only the first paste of an entry in a given
+// type pays for the encoding and every later one is a lookup.
+//
+// That wait still blocks: EntryMimeData calls encoded() from
+// QMimeData::retrieveData() on the GUI thread, which has to return the
+// data. Only the prefetched type (image/png or text/plain) is normally
+// ready. A paste that first asks for another image type (image/bmp,
+// image/jpeg ...), or that comes before the prefetch is done, stalls the
+// GUI thread for one encoding of that image. Not every type is
+// prefetched: for a large screenshot that would take seconds of CPU and
+// push the PNGs of other entries out of the budget.
+class EncodedCache
+{
+public:
+    static constexpr qsizetype DefaultBudget = 64 * 1024 * 1024;
+
+    explicit EncodedCache(qsizetype budgetBytes = DefaultBudget);
+    ~EncodedCache();
+
+    // Starts encoding unless the result is cached or already under way
+    void prefetch(quint64 key, const QString &mimeType, const QVariant &content);
+    // The encoded data, waiting for the encoding if needed. Empty if the
+    // content cannot be encoded as mimeType.
+    QByteArray encoded(quint64 key, const QString &mimeType, const QVariant &content);
+    void clear();
+
+    qsizetype encodedBytes() const;
+
+    // The image MIME types the encoder writes, image/png first
+    static QStringList imageFormats();
+    // content (a QString or QImage) as mimeType, on the calling thread
+    static QByteArray encode(const QVariant &content, const QString &mimeType);
+
+private:
+    using Key = QPair<quint64, QString>;
+
+    // With m_mutex held
+    void start(const Key &key, const QVariant &content);
+
+    mutable QMutex m_mutex;
+    QWaitCondition m_finished;
+    QCache<Key, QByteArray> m_encoded;
+    QSet<Key> m_pending;
+    // A result over the whole budget, kept until it is asked for once
+    Key m_oversizedKey;
+    QByteArray m_oversized;
+    QThreadPool m_pool;
+};
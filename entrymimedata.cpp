@@ -0,0 +1,70 @@
+#include "entrymimedata.h"
+#include "encodedcache.h"
+#include "trace.h"
+
+#include <QImage>
+
+#include <utility>
+
+namespace {
+
+// Qt's own name for an image put on the clipboard as a QImage
+const QString QtImageFormat = QStringLiteral("application/x-qt-image");
+const QString PngFormat = QStringLiteral("image/png");
+const QString TextFormat = QStringLiteral("text/plain");
+
+} // namespace
+
+EntryMimeData::EntryMimeData(quint64 contentKey, const QVariant &content, const OriginalFormats::List &originals,
+                             std::shared_ptr<EncodedCache> cache)
+    : m_contentKey(contentKey)
+    , m_content(content)
+    , m_originals(originals)
+    , m_cache(std::move(cache))
+{
+    // Almost every paste asks for one of these first
+    m_cache->prefetch(m_contentKey, isImage() ? PngFormat : TextFormat, m_content);
+}
+
+QStringList EntryMimeData::formats() const
+{
+    QStringList result;
+    for (const auto &original : m_originals)
+        result.append(original.first);
+    if (isImage()) {
+        result.append(QtImageFormat);
+        result.append(EncodedCache::imageFormats());
+    } else {
+        result.append(TextFormat);
+        result.append(QStringLiteral("text/plain;charset=utf-8"));
+    }
+    return result;
+}
+
+bool EntryMimeData::hasFormat(const QString &mimeType) const
+{
+    return formats().contains(mimeType);
+}
+
+QVariant EntryMimeData::retrieveData(const QString &mimeType, QMetaType type) const
+{
+    for (const auto &original : m_originals) {
+        if (original.first == mimeType)
+            return original.second;
+    }
+
+    const bool offered = isImage() ? mimeType == QtImageFormat || mimeType.startsWith(QLatin1String("image/"))
+                                   : mimeType.startsWith(TextFormat);
+    if (!offered)
+        return QVariant();
+    // In-process readers take the content as it is
+    if (type.id() == m_content.typeId())
+        return m_content;
+
+    // Waits for the encoding if the type was not prefetched (see EncodedCache)
+    const qint64 started = Trace::now();
+    const QByteArray data = m_cache->encoded(m_contentKey, mimeType == QtImageFormat ? PngFormat : mimeType,
+                                             m_content);
+    Trace::record(Trace::PasteServe, started, Trace::now(), data.size());
+    return data.isEmpty() ? QVariant() : QVariant(data);
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include "originalformats.h"
+
+#include <QMimeData>
+#include <QVariant>
+
+#include <memory>
+
+class EncodedCache;
+
+// What activating a history entry puts on the clipboard: the entry offered
+// as every type it can be encoded to, after the OriginalFormats it was
+// copied in.
+//
+// Paste requests are answered from an EncodedCache, so each type is
+// encoded once per entry rather than on every paste. The type asked for
+// most (image/png or text/plain) is prefetched on construction.
+class EntryMimeData : public QMimeData
+{
+    Q_OBJECT
+
+public:
+    EntryMimeData(quint64 contentKey, const QVariant &content, const OriginalFormats::List &originals,
+                  std::shared_ptr<EncodedCache> cache);
+
+    // The entry as the history holds it, a QString or QImage
+    const QVariant &content() const { return m_content; }
+    quint64 contentKey() const { return m_contentKey; }
+
+    QStringList formats() const override;
+    bool hasFormat(const QString &mimeType) const override;
+
+protected:
+    QVariant retrieveData(const QString &mimeType, QMetaType type) const override;
+
+private:
+    bool isImage() const { return m_content.typeId() == QMetaType::QImage; }
+
+    quint64 m_contentKey;
+    QVariant m_content;
+    OriginalFormats::List m_originals;
+    std::shared_ptr<EncodedCache> m_cache;
+};
@@ -1,9 +1,17 @@
 // --- 1. Include your Qt-facing headers FIRST ---
 #include "globalhotkeymanager.h"
 #include "hotkeyprivate.h"
-#include <QThread>
+#include "trace.h"
+#include <QSettings>
+#include <QStringList>
 #include <iostream>
 
+#include <cerrno>
+#include <cstdint>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
 // --- 2. Then include X11 ---
 #include <X11/Xlib.h>
 #include <X11/keysym.h>
@@ -17,36 +25,128 @@
 #undef Above
 #undef Below
 
+namespace {
+
+// Modifiers we compare against; Lock and NumLock are ignored on purpose.
+constexpr unsigned int RelevantModifiers = ShiftMask | ControlMask | Mod1Mask | Mod4Mask;
+
+// Set by grabErrorHandler when XGrabKey fails (usually BadAccess because
+// another application already owns the combination).
+bool g_grabFailed = false;
+
+int grabErrorHandler(Display *, XErrorEvent *)
+{
+    g_grabFailed = true;
+    return 0;
+}
+
+// Parses "Ctrl+Alt+V" style sequences into an X modifier mask and keysym.
+bool parseSequence(const QString &sequence, unsigned int *modifiers, KeySym *keysym)
+{
+    const QStringList parts = sequence.split('+', Qt::SkipEmptyParts);
+    if (parts.isEmpty())
+        return false;
+
+    *modifiers = 0;
+    for (int i = 0; i < parts.size() - 1; ++i) {
+        const QString mod = parts.at(i).trimmed().toLower();
+        if (mod == "ctrl" || mod == "control")
+            *modifiers |= ControlMask;
+        else if (mod == "alt")
+            *modifiers |= Mod1Mask;
+        else if (mod == "shift")
+            *modifiers |= ShiftMask;
+        else if (mod == "super" || mod == "meta" || mod == "win")
+            *modifiers |= Mod4Mask;
+        else
+            return false;
+    }
+
+    *keysym = XStringToKeysym(parts.last().trimmed().toLatin1().constData());
+    return *keysym != NoSymbol;
+}
+
+} // namespace
+
 // --- 4. Implementation of GlobalHotkeyManager ---
 
-GlobalHotkeyManager::GlobalHotkeyManager(QObject *parent)
-    : QObject(parent), d(std::make_unique<HotkeyPrivate>())
+GlobalHotkeyManager::GlobalHotkeyManager(const QList<HotkeyBinding> &bindings, QObject *parent)
+    : QObject(parent), d(std::make_unique<HotkeyPrivate>()), m_bindings(bindings)
 {
 }
 
 GlobalHotkeyManager::~GlobalHotkeyManager() = default;
 
+QList<HotkeyBinding> GlobalHotkeyManager::bindingsFromSettings()
+{
+    QList<HotkeyBinding> bindings;
+    QSettings settings;
+    settings.beginGroup("Hotkeys");
+    for (const QString &action : settings.childKeys()) {
+        // Several sequences may share one action: toggle=Ctrl+Alt+V, Super+V
+        const QStringList sequences = settings.value(action).toStringList();
+        for (const QString &sequence : sequences)
+            bindings.append({ sequence.trimmed(), action });
+    }
+    settings.endGroup();
+
+    if (bindings.isEmpty())
+        bindings.append({ QStringLiteral("Ctrl+Alt+V"), QStringLiteral("toggle") });
+    return bindings;
+}
+
 void GlobalHotkeyManager::run()
 {
-    if (!d->registerHotkey()) {
+    if (!d->registerHotkeys(m_bindings.constData(), m_bindings.size())) {
         std::cerr << "Hotkey registration failed. Thread will now exit." << std::endl;
         emit finished();
         return;
     }
 
-    // This is a proper non-blocking event loop suitable for a Qt thread
-    while (!QThread::currentThread()->isInterruptionRequested()) {
-        if (XPending(d->display)) {
+    // Block on the X connection and the wake-up eventfd instead of polling,
+    // so the thread costs nothing while idle and reacts to a key immediately.
+    pollfd fds[2];
+    fds[0].fd = ConnectionNumber(d->display);
+    fds[0].events = POLLIN;
+    fds[1].fd = d->wakeFd;
+    fds[1].events = POLLIN;
+
+    // When poll() last returned: the earliest we can know about an event
+    qint64 wokeAt = Trace::now();
+    while (!m_stop.load(std::memory_order_acquire)) {
+        // XPending() also flushes our requests and reads whatever is
+        // already buffered, so nothing is left behind before we block.
+        while (XPending(d->display)) {
             XEvent ev;
             XNextEvent(d->display, &ev);
             if (ev.type == KeyPress) {
-                // --- THE FIX ---
-                // Use the correct signal name from the latest .h file
-                emit hotkeyPressed();
+                const int binding = d->bindingForEvent(ev.xkey);
+                if (binding >= 0) {
+                    // Marked before emitting; the GUI thread may take them right away
+                    const qint64 emittedAt = Trace::now();
+                    Trace::setMark(Trace::HotkeyReceivedMark, wokeAt);
+                    Trace::setMark(Trace::HotkeyEmittedMark, emittedAt);
+                    emit hotkeyPressed(m_bindings.at(binding).action);
+                    Trace::record(Trace::HotkeyEvent, wokeAt, emittedAt);
+                }
             }
-        } else {
-            // Sleep briefly to avoid 100% CPU usage
-            QThread::msleep(20);
+        }
+
+        const int ready = poll(fds, 2, -1);
+        wokeAt = Trace::now();
+        if (ready < 0) {
+            if (errno == EINTR)
+                continue;
+            std::cerr << "Error: poll() on the X connection failed." << std::endl;
+            break;
+        }
+        if (fds[0].revents & (POLLERR | POLLHUP)) {
+            std::cerr << "Error: Lost the X connection." << std::endl;
+            break;
+        }
+        if (fds[1].revents & POLLIN) {
+            uint64_t value;
+            while (read(d->wakeFd, &value, sizeof(value)) > 0) {}
         }
     }
 
@@ -55,24 +155,40 @@ void GlobalHotkeyManager::run()
 
 void GlobalHotkeyManager::stop()
 {
-    // The main window will call requestInterruption() on the thread,
-    // which will cause the loop in run() to terminate.
-    // This function is here to match the slot in the header.
+    // Called from the GUI thread; the eventfd write wakes poll() in run().
+    m_stop.store(true, std::memory_order_release);
+    if (d->wakeFd >= 0) {
+        const uint64_t one = 1;
+        if (write(d->wakeFd, &one, sizeof(one)) < 0)
+            std::cerr << "Error: Cannot wake the hotkey thread." << std::endl;
+    }
 }
 
 
 // --- 5. Implementation of HotkeyPrivate ---
 
+HotkeyPrivate::HotkeyPrivate()
+    : wakeFd(eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK))
+{
+    if (wakeFd < 0)
+        std::cerr << "Error: Cannot create the hotkey wake-up eventfd." << std::endl;
+}
+
 HotkeyPrivate::~HotkeyPrivate()
 {
     if (display) {
-        unregisterHotkey();
+        unregisterHotkeys();
         XCloseDisplay(display);
     }
+    if (wakeFd >= 0)
+        close(wakeFd);
 }
 
-bool HotkeyPrivate::registerHotkey()
+bool HotkeyPrivate::registerHotkeys(const HotkeyBinding *bindings, int count)
 {
+    if (wakeFd < 0)
+        return false;
+
     display = XOpenDisplay(nullptr);
     if (!display) {
         std::cerr << "Error: Cannot open X display." << std::endl;
@@ -80,11 +196,9 @@ bool HotkeyPrivate::registerHotkey()
     }
 
     rootWindow = DefaultRootWindow(display);
-    keycode = XKeysymToKeycode(display, XK_V);
-    unsigned int modifiers = ControlMask | Mod1Mask; // Ctrl + Alt
 
     // Robustly handle NumLock and CapsLock modifiers
-    unsigned int numLockMask = 0;
+    numLockMask = 0;
     XModifierKeymap *modmap = XGetModifierMapping(display);
     KeyCode numLockKeyCode = XKeysymToKeycode(display, XK_Num_Lock);
     if (numLockKeyCode != 0) {
@@ -98,20 +212,62 @@ bool HotkeyPrivate::registerHotkey()
     }
     XFreeModifiermap(modmap);
 
-    XGrabKey(display, keycode, modifiers, rootWindow, True, GrabModeAsync, GrabModeAsync);
-    XGrabKey(display, keycode, modifiers | LockMask, rootWindow, True, GrabModeAsync, GrabModeAsync);
-    if (numLockMask != 0) {
-        XGrabKey(display, keycode, modifiers | numLockMask, rootWindow, True, GrabModeAsync, GrabModeAsync);
-        XGrabKey(display, keycode, modifiers | LockMask | numLockMask, rootWindow, True, GrabModeAsync, GrabModeAsync);
+    const unsigned int ignoredMasks[] = { 0, LockMask, numLockMask, LockMask | numLockMask };
+    const int ignoredCount = numLockMask != 0 ? 4 : 2;
+
+    for (int i = 0; i < count; ++i) {
+        unsigned int modifiers = 0;
+        KeySym keysym = NoSymbol;
+        if (!parseSequence(bindings[i].sequence, &modifiers, &keysym)) {
+            std::cerr << "Warning: Ignoring invalid hotkey \""
+                      << bindings[i].sequence.toStdString() << "\"." << std::endl;
+            continue;
+        }
+        const int keycode = XKeysymToKeycode(display, keysym);
+        if (keycode == 0) {
+            std::cerr << "Warning: No key on this keyboard for \""
+                      << bindings[i].sequence.toStdString() << "\"." << std::endl;
+            continue;
+        }
+
+        // Grab errors are asynchronous; sync and check them per binding so
+        // one combination taken by another program does not kill us.
+        g_grabFailed = false;
+        XErrorHandler previous = XSetErrorHandler(grabErrorHandler);
+        for (int m = 0; m < ignoredCount; ++m)
+            XGrabKey(display, keycode, modifiers | ignoredMasks[m], rootWindow, True, GrabModeAsync, GrabModeAsync);
+        XSync(display, False);
+        XSetErrorHandler(previous);
+
+        if (g_grabFailed) {
+            std::cerr << "Warning: \"" << bindings[i].sequence.toStdString()
+                      << "\" is already grabbed by another application." << std::endl;
+            for (int m = 0; m < ignoredCount; ++m)
+                XUngrabKey(display, keycode, modifiers | ignoredMasks[m], rootWindow);
+            continue;
+        }
+        grabs.push_back({ keycode, modifiers, i });
     }
 
     XSync(display, False);
-    return true;
+    return !grabs.empty();
 }
 
-void HotkeyPrivate::unregisterHotkey()
+void HotkeyPrivate::unregisterHotkeys()
 {
     if (display) {
-        XUngrabKey(display, keycode, AnyModifier, rootWindow);
+        for (const Grab &grab : grabs)
+            XUngrabKey(display, grab.keycode, AnyModifier, rootWindow);
+        grabs.clear();
+    }
+}
+
+int HotkeyPrivate::bindingForEvent(const XKeyEvent &event) const
+{
+    const unsigned int state = event.state & RelevantModifiers;
+    for (const Grab &grab : grabs) {
+        if (grab.keycode == static_cast<int>(event.keycode) && grab.modifiers == state)
+            return grab.binding;
     }
+    return -1;
 }
@@ -1,30 +1,47 @@
 #pragma once
 
 #include <QObject>
+#include <QList>
+#include <QString>
+#include <atomic>
 #include <memory> // For std::unique_ptr
 
 // This is the PIMPL pattern. The header is clean of any X11 includes.
 class HotkeyPrivate;
 
+// One entry of the hotkey table: a key sequence such as "Ctrl+Alt+V"
+// and the action name that is reported when it is pressed.
+struct HotkeyBinding
+{
+    QString sequence;
+    QString action;
+};
+
 class GlobalHotkeyManager : public QObject
 {
     Q_OBJECT
 
 public:
-    explicit GlobalHotkeyManager(QObject *parent = nullptr);
+    explicit GlobalHotkeyManager(const QList<HotkeyBinding> &bindings, QObject *parent = nullptr);
     ~GlobalHotkeyManager();
 
+    // Reads the [Hotkeys] group of the settings file (action=sequence).
+    // Falls back to Ctrl+Alt+V -> "toggle" when nothing is configured.
+    static QList<HotkeyBinding> bindingsFromSettings();
+
 public slots:
     void run();
-    // --- ADDED: This slot will be connected to the application's aboutToQuit signal ---
+    // Thread-safe: wakes the blocking loop in run(). Connect it with
+    // Qt::DirectConnection, the hotkey thread never returns to its event loop.
     void stop();
 
 signals:
-    // --- ADDED: This signal is emitted when the hotkey is pressed ---
-    void hotkeyPressed();
+    // Emitted from the hotkey thread with the action of the binding that fired
+    void hotkeyPressed(const QString &action);
     void finished();
 
 private:
     std::unique_ptr<HotkeyPrivate> d; // Pointer to implementation
-    volatile bool m_stop = false;
+    QList<HotkeyBinding> m_bindings;
+    std::atomic<bool> m_stop { false };
 };
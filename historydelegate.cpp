@@ -0,0 +1,27 @@
+#include "historydelegate.h"
+
+#include <QFontMetrics>
+
+namespace {
+// Matches the "padding: 6px 8px" item rule of the view's stylesheet
+constexpr int VerticalPadding = 6;
+}
+
+HistoryDelegate::HistoryDelegate(QObject *parent)
+    : QStyledItemDelegate(parent)
+{
+}
+
+QSize HistoryDelegate::sizeHint(const QStyleOptionViewItem &option, const QModelIndex &) const
+{
+    const int contentHeight = qMax(IconSize, option.fontMetrics.height());
+    return QSize(option.rect.width(), contentHeight + 2 * VerticalPadding);
+}
+
+void HistoryDelegate::initStyleOption(QStyleOptionViewItem *option, const QModelIndex &index) const
+{
+    QStyledItemDelegate::initStyleOption(option, index);
+    option->decorationSize = QSize(IconSize, IconSize);
+    option->textElideMode = Qt::ElideRight;
+    option->features &= ~QStyleOptionViewItem::WrapText;
+}
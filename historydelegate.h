@@ -0,0 +1,21 @@
+#pragma once
+
+#include <QStyledItemDelegate>
+
+// Delegate for the history view. Every row has the same fixed height, so
+// together with QListView::setUniformItemSizes() nothing is ever measured,
+// and labels are drawn as a single elided line.
+class HistoryDelegate : public QStyledItemDelegate
+{
+    Q_OBJECT
+
+public:
+    static constexpr int IconSize = 32;
+
+    explicit HistoryDelegate(QObject *parent = nullptr);
+
+    QSize sizeHint(const QStyleOptionViewItem &option, const QModelIndex &index) const override;
+
+protected:
+    void initStyleOption(QStyleOptionViewItem *option, const QModelIndex &index) const override;
+};
@@ -0,0 +1,859 @@
+#include "historylog.h"
+
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QRandomGenerator>
+#include <iostream>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstring>
+#include <utility>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+// --- On-disk layout ---
+//
+// history.dat: FileHeader, then records back to back:
+//   RecordHeader | label (UTF-8) | payload
+// Payloads are opaque here: UTF-8 for text, an ImageCodec stream for images.
+//
+// history.idx: FileHeader, then one IndexEntry per record in append order.
+// Both headers carry the same fileId so a half-finished compaction is
+// detected on the next start.
+
+struct FileHeader {
+    char magic[8];
+    quint32 version;
+    quint32 reserved0;
+    quint64 fileId;
+    quint64 reserved1;
+};
+
+struct RecordHeader {
+    quint32 magic;
+    quint32 crc;
+    quint64 payloadLength;
+    quint32 labelLength;
+    quint8 type;
+    quint8 reserved[3];
+    qint64 timestamp;
+};
+
+static_assert(sizeof(FileHeader) == 32, "FileHeader layout");
+static_assert(sizeof(RecordHeader) == 32, "RecordHeader layout");
+
+constexpr char DataMagic[8] = { 'L', 'C', 'L', 'I', 'P', 'D', 'A', 'T' };
+constexpr char IndexMagic[8] = { 'L', 'C', 'L', 'I', 'P', 'I', 'D', 'X' };
+constexpr quint32 FormatVersion = 2; // 2: images are stored compressed
+constexpr quint32 RecordMagic = 0x4452434c; // "LCRD"
+constexpr quint8 DeletedFlag = 0x01;
+
+// Compact once dead records outweigh live ones and are worth the I/O
+constexpr quint64 CompactionThreshold = 16 * 1024 * 1024;
+// The data mapping grows in steps so appends rarely have to remap
+constexpr quint64 MapGranularity = 64 * 1024 * 1024;
+
+// --- CRC-32 (IEEE), slicing-by-8 ---
+
+struct Crc32Tables {
+    quint32 t[8][256];
+    Crc32Tables()
+    {
+        for (quint32 i = 0; i < 256; ++i) {
+            quint32 c = i;
+            for (int k = 0; k < 8; ++k)
+                c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            t[0][i] = c;
+        }
+        for (quint32 i = 0; i < 256; ++i)
+            for (int s = 1; s < 8; ++s)
+                t[s][i] = (t[s - 1][i] >> 8) ^ t[0][t[s - 1][i] & 0xff];
+    }
+};
+
+quint32 crc32(quint32 crc, const void *data, size_t length)
+{
+    static const Crc32Tables tables;
+    const auto &t = tables.t;
+    const uchar *p = static_cast<const uchar *>(data);
+    crc = ~crc;
+    while (length >= 8) {
+        quint32 lo, hi;
+        std::memcpy(&lo, p, 4);
+        std::memcpy(&hi, p + 4, 4);
+        lo ^= crc;
+        crc = t[7][lo & 0xff] ^ t[6][(lo >> 8) & 0xff] ^ t[5][(lo >> 16) & 0xff] ^ t[4][lo >> 24]
+            ^ t[3][hi & 0xff] ^ t[2][(hi >> 8) & 0xff] ^ t[1][(hi >> 16) & 0xff] ^ t[0][hi >> 24];
+        p += 8;
+        length -= 8;
+    }
+    while (length--)
+        crc = t[0][(crc ^ *p++) & 0xff] ^ (crc >> 8);
+    return ~crc;
+}
+
+// --- POSIX helpers ---
+
+bool preadAll(int fd, void *data, size_t length, quint64 offset)
+{
+    char *p = static_cast<char *>(data);
+    while (length > 0) {
+        const ssize_t n = pread(fd, p, length, off_t(offset));
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        p += n;
+        length -= size_t(n);
+        offset += quint64(n);
+    }
+    return true;
+}
+
+bool pwriteAll(int fd, const void *data, size_t length, quint64 offset)
+{
+    const char *p = static_cast<const char *>(data);
+    while (length > 0) {
+        const ssize_t n = pwrite(fd, p, length, off_t(offset));
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        p += n;
+        length -= size_t(n);
+        offset += quint64(n);
+    }
+    return true;
+}
+
+quint64 fileSize(int fd)
+{
+    struct stat st;
+    return fstat(fd, &st) == 0 ? quint64(st.st_size) : 0;
+}
+
+bool readHeader(int fd, const char (&magic)[8], FileHeader *header)
+{
+    return preadAll(fd, header, sizeof(*header), 0)
+        && std::memcmp(header->magic, magic, sizeof(magic)) == 0
+        && header->version == FormatVersion;
+}
+
+bool writeHeader(int fd, const char (&magic)[8], quint64 fileId)
+{
+    FileHeader header = {};
+    std::memcpy(header.magic, magic, sizeof(magic));
+    header.version = FormatVersion;
+    header.fileId = fileId;
+    return pwriteAll(fd, &header, sizeof(header), 0);
+}
+
+int openFile(const QString &path, int flags)
+{
+    return ::open(QFile::encodeName(path).constData(), flags | O_CLOEXEC, 0600);
+}
+
+template <typename Entry>
+quint32 entryChecksum(const Entry &entry)
+{
+    return crc32(0, &entry, offsetof(Entry, entryCrc));
+}
+
+template <typename Entry>
+quint64 recordSize(const Entry &entry)
+{
+    return sizeof(RecordHeader) + entry.labelLength + entry.payloadLength;
+}
+
+} // namespace
+
+// --- HistoryLog ---
+
+HistoryLog::HistoryLog(QObject *parent)
+    : QObject(parent)
+{
+    static_assert(sizeof(IndexEntry) == 64, "IndexEntry layout");
+    m_worker.setMaxThreadCount(1);
+}
+
+HistoryLog::~HistoryLog()
+{
+    m_worker.waitForDone();
+    close();
+}
+
+bool HistoryLog::open(const QString &directory)
+{
+    QWriteLocker locker(&m_lock);
+    close();
+
+    if (!QDir().mkpath(directory)) {
+        std::cerr << "Error: Cannot create history directory " << directory.toStdString() << std::endl;
+        return false;
+    }
+    m_directory = directory;
+    const QString dataPath = directory + "/history.dat";
+    const QString indexPath = directory + "/history.idx";
+    const QString pendingIndexPath = indexPath + ".compact";
+
+    m_dataFd = openFile(dataPath, O_RDWR | O_CREAT);
+    if (m_dataFd < 0) {
+        std::cerr << "Error: Cannot open " << dataPath.toStdString() << std::endl;
+        return false;
+    }
+
+    FileHeader dataHeader = {};
+    if (fileSize(m_dataFd) == 0) {
+        const quint64 fileId = QRandomGenerator::global()->generate64();
+        if (!writeHeader(m_dataFd, DataMagic, fileId) || !readHeader(m_dataFd, DataMagic, &dataHeader)) {
+            close();
+            return false;
+        }
+        ::unlink(QFile::encodeName(indexPath).constData());
+    } else if (!readHeader(m_dataFd, DataMagic, &dataHeader)) {
+        if (std::memcmp(dataHeader.magic, DataMagic, sizeof(DataMagic)) != 0) {
+            std::cerr << "Error: " << dataPath.toStdString() << " is not a LinClip history file." << std::endl;
+            close();
+            return false;
+        }
+        // An older format version: there is no migration, start over
+        std::cerr << "Warning: History format " << dataHeader.version << " is no longer supported, starting over." << std::endl;
+        const quint64 fileId = QRandomGenerator::global()->generate64();
+        if (ftruncate(m_dataFd, 0) != 0 || !writeHeader(m_dataFd, DataMagic, fileId)
+            || !readHeader(m_dataFd, DataMagic, &dataHeader)) {
+            close();
+            return false;
+        }
+    }
+
+    // A compaction that was interrupted after renaming the data file
+    // leaves its matching index behind; finish the job.
+    const int pendingFd = openFile(pendingIndexPath, O_RDONLY);
+    if (pendingFd >= 0) {
+        FileHeader pendingHeader;
+        const bool matches = readHeader(pendingFd, IndexMagic, &pendingHeader)
+                             && pendingHeader.fileId == dataHeader.fileId;
+        ::close(pendingFd);
+        if (matches)
+            ::rename(QFile::encodeName(pendingIndexPath).constData(), QFile::encodeName(indexPath).constData());
+        else
+            ::unlink(QFile::encodeName(pendingIndexPath).constData());
+    }
+    ::unlink(QFile::encodeName(dataPath + ".compact").constData());
+
+    m_indexFd = openFile(indexPath, O_RDWR | O_CREAT);
+    if (m_indexFd < 0) {
+        std::cerr << "Error: Cannot open " << indexPath.toStdString() << std::endl;
+        close();
+        return false;
+    }
+
+    FileHeader indexHeader;
+    const quint64 indexSize = fileSize(m_indexFd);
+    if (indexSize == 0 || !readHeader(m_indexFd, IndexMagic, &indexHeader)
+        || indexHeader.fileId != dataHeader.fileId) {
+        if (indexSize != 0)
+            std::cerr << "Warning: History index does not match the data file, starting over." << std::endl;
+        if (ftruncate(m_dataFd, sizeof(FileHeader)) != 0 || ftruncate(m_indexFd, 0) != 0
+            || !writeHeader(m_indexFd, IndexMagic, dataHeader.fileId)) {
+            close();
+            return false;
+        }
+    }
+
+    // Only the fixed-size index is read at startup
+    const quint64 count = (fileSize(m_indexFd) - sizeof(FileHeader)) / sizeof(IndexEntry);
+    m_index.resize(count);
+    if (count > 0) {
+        const size_t length = sizeof(FileHeader) + count * sizeof(IndexEntry);
+        void *map = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, m_indexFd, 0);
+        if (map == MAP_FAILED) {
+            std::cerr << "Error: Cannot map the history index." << std::endl;
+            close();
+            return false;
+        }
+        std::memcpy(m_index.data(), static_cast<const char *>(map) + sizeof(FileHeader), count * sizeof(IndexEntry));
+        munmap(map, length);
+    }
+
+    m_dataSize = fileSize(m_dataFd);
+    if (!remap(m_dataSize) || !validate()) {
+        close();
+        return false;
+    }
+    return true;
+}
+
+void HistoryLog::close()
+{
+    if (m_map)
+        munmap(const_cast<uchar *>(m_map), m_mapSize);
+    m_map = nullptr;
+    m_mapSize = 0;
+    if (m_dataFd >= 0)
+        ::close(m_dataFd);
+    if (m_indexFd >= 0)
+        ::close(m_indexFd);
+    m_dataFd = m_indexFd = -1;
+    m_index.clear();
+    m_slotById.clear();
+    m_unwritten.clear();
+    m_liveBytes = m_deadBytes = 0;
+}
+
+bool HistoryLog::remap(quint64 minimumSize)
+{
+    if (m_map && minimumSize <= m_mapSize)
+        return true;
+
+    const quint64 size = ((minimumSize + minimumSize / 2) / MapGranularity + 1) * MapGranularity;
+    if (m_map)
+        munmap(const_cast<uchar *>(m_map), m_mapSize);
+    // Mapping past the end of the file is fine as long as nothing reads there
+    void *map = mmap(nullptr, size, PROT_READ, MAP_SHARED, m_dataFd, 0);
+    if (map == MAP_FAILED) {
+        std::cerr << "Error: Cannot map the history data file." << std::endl;
+        m_map = nullptr;
+        m_mapSize = 0;
+        return false;
+    }
+    m_map = static_cast<const uchar *>(map);
+    m_mapSize = size;
+    return true;
+}
+
+bool HistoryLog::validate()
+{
+    // Keep the longest prefix of index entries that are intact and point
+    // at consecutive records inside the data file.
+    quint64 expectedOffset = sizeof(FileHeader);
+    size_t valid = 0;
+    for (; valid < m_index.size(); ++valid) {
+        const IndexEntry &entry = m_index[valid];
+        if (entry.entryCrc != entryChecksum(entry) || entry.offset != expectedOffset
+            || entry.offset + recordSize(entry) > m_dataSize)
+            break;
+        expectedOffset += recordSize(entry);
+    }
+
+    // Records are synced before their index entry is written, so only the
+    // newest one can be torn. Check it in full, drop it if it is.
+    if (valid > 0 && !recordIsIntact(m_index[valid - 1])) {
+        --valid;
+        expectedOffset = m_index[valid].offset;
+    }
+
+    if (valid != m_index.size() || expectedOffset != m_dataSize) {
+        std::cerr << "Warning: Dropping " << (m_index.size() - valid)
+                  << " damaged history record(s) at the end of the log." << std::endl;
+        m_index.resize(valid);
+        if (ftruncate(m_indexFd, off_t(sizeof(FileHeader) + valid * sizeof(IndexEntry))) != 0
+            || ftruncate(m_dataFd, off_t(expectedOffset)) != 0)
+            return false;
+        m_dataSize = expectedOffset;
+    }
+
+    for (size_t slot = 0; slot < m_index.size(); ++slot) {
+        const IndexEntry &entry = m_index[slot];
+        m_nextId = qMax(m_nextId, entry.id + 1);
+        m_lastTimestamp = qMax(m_lastTimestamp, entry.timestamp);
+        if (entry.flags & DeletedFlag) {
+            m_deadBytes += recordSize(entry);
+        } else {
+            m_liveBytes += recordSize(entry);
+            m_slotById.insert(entry.id, int(slot));
+        }
+    }
+    return true;
+}
+
+bool HistoryLog::headerIsIntact(const IndexEntry &entry) const
+{
+    RecordHeader header;
+    std::memcpy(&header, m_map + entry.offset, sizeof(header));
+    return header.magic == RecordMagic && header.payloadLength == entry.payloadLength
+        && header.labelLength == entry.labelLength;
+}
+
+bool HistoryLog::recordIsIntact(const IndexEntry &entry) const
+{
+    if (!headerIsIntact(entry))
+        return false;
+    const quint64 length = entry.labelLength + entry.payloadLength;
+    return crc32(0, m_map + entry.offset + sizeof(RecordHeader), length) == entry.recordCrc;
+}
+
+qint64 HistoryLog::nextTimestamp()
+{
+    // Ties would make records() fall back to slot order, which is wrong
+    // for touched entries, so never hand out the same value twice.
+    m_lastTimestamp = qMax(QDateTime::currentMSecsSinceEpoch(), m_lastTimestamp + 1);
+    return m_lastTimestamp;
+}
+
+bool HistoryLog::writeIndexEntry(int slot, const IndexEntry &entry)
+{
+    return pwriteAll(m_indexFd, &entry, sizeof(entry), sizeof(FileHeader) + quint64(slot) * sizeof(IndexEntry));
+}
+
+QList<HistoryLog::Record> HistoryLog::records() const
+{
+    QReadLocker locker(&m_lock);
+    QList<Record> result;
+    result.reserve(m_slotById.size());
+    for (const IndexEntry &entry : m_index) {
+        if (!(entry.flags & DeletedFlag))
+            result.append({ entry.id, Type(entry.type), entry.contentKey, entry.timestamp, entry.payloadLength, entry.lineCount });
+    }
+    // Append order already matches unless entries were copied again
+    std::stable_sort(result.begin(), result.end(), [](const Record &a, const Record &b) {
+        return a.timestamp < b.timestamp;
+    });
+    return result;
+}
+
+quint64 HistoryLog::append(Type type, const QByteArray &payload, quint64 contentKey, const QString &label,
+                           quint32 lineCount)
+{
+    Unwritten record;
+    record.label = label.toUtf8();
+    record.payload = payload;
+    RecordHeader header = {};
+    header.magic = RecordMagic;
+    header.type = type;
+    header.labelLength = quint32(record.label.size());
+    header.payloadLength = quint64(payload.size());
+
+    QWriteLocker locker(&m_lock);
+    if (!isOpen())
+        return 0;
+
+    header.timestamp = nextTimestamp();
+    record.header = QByteArray(reinterpret_cast<const char *>(&header), sizeof(header));
+
+    IndexEntry entry = {};
+    entry.id = m_nextId;
+    entry.offset = m_dataSize;
+    entry.payloadLength = header.payloadLength;
+    entry.contentKey = contentKey;
+    entry.timestamp = header.timestamp;
+    entry.labelLength = header.labelLength;
+    entry.recordCrc = 0; // Set once seal() has run on m_worker
+    entry.type = header.type;
+    entry.lineCount = lineCount;
+    entry.entryCrc = entryChecksum(entry);
+
+    // The disk is left to the worker: a slow one must not hold up the GUI
+    record.slot = int(m_index.size());
+    record.offset = entry.offset;
+    m_index.push_back(entry);
+    m_slotById.insert(entry.id, record.slot);
+    m_unwritten.insert(entry.id, record);
+    m_dataSize += recordSize(entry);
+    m_liveBytes += recordSize(entry);
+    if (!m_flushScheduled) {
+        m_flushScheduled = true;
+        m_worker.start([this]() { flush(); });
+    }
+    return m_nextId++;
+}
+
+quint32 HistoryLog::seal(Unwritten *record)
+{
+    quint32 crc = crc32(0, record->label.constData(), size_t(record->label.size()));
+    crc = crc32(crc, record->payload.constData(), size_t(record->payload.size()));
+    std::memcpy(record->header.data() + offsetof(RecordHeader, crc), &crc, sizeof(crc));
+    return crc;
+}
+
+void HistoryLog::flush()
+{
+    QMutexLocker files(&m_fileMutex);
+    QMap<quint64, Unwritten> batch;
+    int dataFd;
+    {
+        QWriteLocker locker(&m_lock);
+        m_flushScheduled = false;
+        batch = m_unwritten;
+        dataFd = m_dataFd;
+    }
+    if (batch.isEmpty() || dataFd < 0)
+        return;
+
+    bool ok = true;
+    quint64 end = 0;
+    QHash<int, quint32> crcs; // By slot
+    for (Unwritten &record : batch) {
+        crcs.insert(record.slot, seal(&record));
+        quint64 pos = record.offset;
+        for (const QByteArray *part : { &record.header, &record.label, &record.payload }) {
+            ok = ok && pwriteAll(dataFd, part->constData(), size_t(part->size()), pos);
+            pos += quint64(part->size());
+        }
+        end = pos;
+    }
+    // The records must be on disk before an index entry points at them
+    ok = ok && fdatasync(dataFd) == 0;
+
+    QWriteLocker locker(&m_lock);
+    if (!ok) {
+        // They stay readable from memory and are tried again by the next flush
+        std::cerr << "Error: Cannot write to the history log: " << std::strerror(errno) << std::endl;
+        return;
+    }
+    // Current entries, with any touch() or remove() made meanwhile
+    for (auto it = batch.cbegin(); it != batch.cend(); ++it) {
+        IndexEntry &entry = m_index[it->slot];
+        entry.recordCrc = crcs.value(it->slot);
+        entry.entryCrc = entryChecksum(entry);
+        writeIndexEntry(it->slot, entry);
+        m_unwritten.remove(it.key());
+    }
+    if (!remap(end))
+        std::cerr << "Error: Cannot map the new history records." << std::endl;
+}
+
+void HistoryLog::remove(quint64 id)
+{
+    {
+        QWriteLocker locker(&m_lock);
+        const int slot = m_slotById.value(id, -1);
+        if (slot < 0)
+            return;
+
+        IndexEntry &entry = m_index[slot];
+        entry.flags |= DeletedFlag;
+        entry.entryCrc = entryChecksum(entry);
+        // flush() writes the entries of unwritten records as they are then
+        if (!m_unwritten.contains(id))
+            writeIndexEntry(slot, entry);
+        m_slotById.remove(id);
+        m_liveBytes -= recordSize(entry);
+        m_deadBytes += recordSize(entry);
+    }
+    scheduleCompaction();
+}
+
+void HistoryLog::touch(quint64 id)
+{
+    QWriteLocker locker(&m_lock);
+    const int slot = m_slotById.value(id, -1);
+    if (slot < 0)
+        return;
+
+    // The timestamp lives in the fixed-size index entry, so this is a
+    // single in-place write rather than a new copy of the payload.
+    IndexEntry &entry = m_index[slot];
+    entry.timestamp = nextTimestamp();
+    entry.entryCrc = entryChecksum(entry);
+    if (!m_unwritten.contains(id))
+        writeIndexEntry(slot, entry);
+}
+
+void HistoryLog::clear()
+{
+    // Waits for a flush that is writing; compaction is aborted instead
+    QMutexLocker files(&m_fileMutex);
+    QWriteLocker locker(&m_lock);
+    if (!isOpen())
+        return;
+
+    ++m_generation;
+    if (ftruncate(m_dataFd, sizeof(FileHeader)) != 0 || ftruncate(m_indexFd, sizeof(FileHeader)) != 0)
+        std::cerr << "Error: Cannot truncate the history log." << std::endl;
+    m_dataSize = sizeof(FileHeader);
+    m_index.clear();
+    m_slotById.clear();
+    m_unwritten.clear();
+    m_liveBytes = m_deadBytes = 0;
+}
+
+QString HistoryLog::label(quint64 id) const
+{
+    QReadLocker locker(&m_lock);
+    const int slot = m_slotById.value(id, -1);
+    if (slot < 0)
+        return QString();
+    const auto unwritten = m_unwritten.constFind(id);
+    if (unwritten != m_unwritten.cend())
+        return QString::fromUtf8(unwritten->label);
+
+    const IndexEntry &entry = m_index[slot];
+    return QString::fromUtf8(reinterpret_cast<const char *>(m_map + entry.offset + sizeof(RecordHeader)),
+                             qsizetype(entry.labelLength));
+}
+
+bool HistoryLog::readPayload(quint64 id, const std::function<void(const char *, qsizetype)> &reader) const
+{
+    QReadLocker locker(&m_lock);
+    const int slot = m_slotById.value(id, -1);
+    if (slot < 0)
+        return false;
+    const auto unwritten = m_unwritten.constFind(id);
+    if (unwritten != m_unwritten.cend()) {
+        reader(unwritten->payload.constData(), unwritten->payload.size());
+        return true;
+    }
+
+    const IndexEntry &entry = m_index[slot];
+    if (!recordIsIntact(entry)) {
+        std::cerr << "Warning: History record " << id << " is damaged." << std::endl;
+        return false;
+    }
+
+    // Straight from the mapping: the reader decodes without an extra copy
+    const uchar *payload = m_map + entry.offset + sizeof(RecordHeader) + entry.labelLength;
+    reader(reinterpret_cast<const char *>(payload), qsizetype(entry.payloadLength));
+    return true;
+}
+
+bool HistoryLog::readPayloadPrefix(quint64 id, qsizetype maxBytes,
+                                   const std::function<void(const char *, qsizetype)> &reader) const
+{
+    QReadLocker locker(&m_lock);
+    const int slot = m_slotById.value(id, -1);
+    if (slot < 0)
+        return false;
+    const auto unwritten = m_unwritten.constFind(id);
+    if (unwritten != m_unwritten.cend()) {
+        reader(unwritten->payload.constData(), qMin(unwritten->payload.size(), maxBytes));
+        return true;
+    }
+
+    const IndexEntry &entry = m_index[slot];
+    if (!headerIsIntact(entry)) {
+        std::cerr << "Warning: History record " << id << " is damaged." << std::endl;
+        return false;
+    }
+    const uchar *payload = m_map + entry.offset + sizeof(RecordHeader) + entry.labelLength;
+    reader(reinterpret_cast<const char *>(payload), qsizetype(qMin<quint64>(entry.payloadLength, quint64(maxBytes))));
+    return true;
+}
+
+QByteArray HistoryLog::payload(quint64 id) const
+{
+    QByteArray result;
+    readPayload(id, [&result](const char *data, qsizetype size) {
+        result = QByteArray(data, size);
+    });
+    return result;
+}
+
+void HistoryLog::scheduleCompaction()
+{
+    {
+        QReadLocker locker(&m_lock);
+        if (m_deadBytes < CompactionThreshold || m_deadBytes < m_liveBytes)
+            return;
+    }
+    if (!m_compacting.exchange(true)) {
+        m_worker.start([this]() {
+            compact();
+            m_compacting = false;
+        });
+    }
+}
+
+void HistoryLog::compact()
+{
+    // Phase 1: copy the live records of a snapshot of the index into new
+    // files, holding the lock only for each chunk so appends go on.
+    std::vector<IndexEntry> snapshot;
+    quint64 generation;
+    QString directory;
+    {
+        QReadLocker locker(&m_lock);
+        snapshot = m_index;
+        generation = m_generation;
+        directory = m_directory;
+    }
+
+    const QString dataPath = directory + "/history.dat";
+    const QString indexPath = directory + "/history.idx";
+    const QString newDataPath = dataPath + ".compact";
+    const QString newIndexPath = indexPath + ".compact";
+    const quint64 fileId = QRandomGenerator::global()->generate64();
+
+    const int newDataFd = openFile(newDataPath, O_RDWR | O_CREAT | O_TRUNC);
+    const int newIndexFd = openFile(newIndexPath, O_RDWR | O_CREAT | O_TRUNC);
+    auto abandon = [&]() {
+        if (newDataFd >= 0)
+            ::close(newDataFd);
+        if (newIndexFd >= 0)
+            ::close(newIndexFd);
+        ::unlink(QFile::encodeName(newDataPath).constData());
+        ::unlink(QFile::encodeName(newIndexPath).constData());
+    };
+    if (newDataFd < 0 || newIndexFd < 0 || !writeHeader(newDataFd, DataMagic, fileId)) {
+        abandon();
+        return;
+    }
+
+    std::vector<IndexEntry> compacted;
+    quint64 writeOffset = sizeof(FileHeader);
+    QByteArray buffer(1024 * 1024, Qt::Uninitialized);
+    auto copyRecord = [&](IndexEntry entry, bool locked) {
+        const quint64 size = recordSize(entry);
+        // Records not flushed yet are copied from memory. Flushes run on
+        // this thread too, so none of them is written meanwhile.
+        Unwritten unwritten;
+        if (locked) {
+            unwritten = m_unwritten.value(entry.id);
+        } else {
+            QReadLocker locker(&m_lock);
+            if (m_generation != generation)
+                return false;
+            unwritten = m_unwritten.value(entry.id);
+        }
+        if (!unwritten.header.isEmpty()) {
+            entry.recordCrc = seal(&unwritten);
+            quint64 pos = writeOffset;
+            for (const QByteArray *part : { &unwritten.header, &unwritten.label, &unwritten.payload }) {
+                if (!pwriteAll(newDataFd, part->constData(), size_t(part->size()), pos))
+                    return false;
+                pos += quint64(part->size());
+            }
+        }
+        for (quint64 done = unwritten.header.isEmpty() ? 0 : size; done < size;) {
+            const quint64 chunk = qMin<quint64>(quint64(buffer.size()), size - done);
+            if (locked) {
+                std::memcpy(buffer.data(), m_map + entry.offset + done, chunk);
+            } else {
+                QReadLocker locker(&m_lock);
+                if (m_generation != generation)
+                    return false;
+                std::memcpy(buffer.data(), m_map + entry.offset + done, chunk);
+            }
+            if (!pwriteAll(newDataFd, buffer.constData(), chunk, writeOffset + done))
+                return false;
+            done += chunk;
+        }
+        entry.offset = writeOffset;
+        entry.entryCrc = entryChecksum(entry);
+        compacted.push_back(entry);
+        writeOffset += size;
+        return true;
+    };
+
+    for (const IndexEntry &entry : snapshot) {
+        if (!(entry.flags & DeletedFlag) && !copyRecord(entry, false)) {
+            abandon();
+            return;
+        }
+    }
+
+    // Catch up with what was appended meanwhile, still without blocking
+    // appends, then write the index as it is now and sync both files. The
+    // write lock below only has to cover the changes made after this.
+    size_t copiedSlots = snapshot.size();
+    std::vector<IndexEntry> appended;
+    {
+        QReadLocker locker(&m_lock);
+        if (m_generation != generation) {
+            abandon();
+            return;
+        }
+        appended.assign(m_index.begin() + qsizetype(copiedSlots), m_index.end());
+    }
+    for (const IndexEntry &entry : appended) {
+        if (!(entry.flags & DeletedFlag) && !copyRecord(entry, false)) {
+            abandon();
+            return;
+        }
+    }
+    copiedSlots += appended.size();
+
+    // The copies are of the snapshot: take what touch() and remove() have
+    // changed since from the live entries. Returns the dead bytes.
+    auto refresh = [&]() {
+        quint64 deadBytes = 0;
+        for (IndexEntry &entry : compacted) {
+            const int liveSlot = m_slotById.value(entry.id, -1);
+            if (liveSlot < 0) {
+                entry.flags |= DeletedFlag;
+                deadBytes += recordSize(entry);
+            } else {
+                entry.timestamp = m_index[liveSlot].timestamp;
+                entry.flags = m_index[liveSlot].flags;
+            }
+            entry.entryCrc = entryChecksum(entry);
+        }
+        return deadBytes;
+    };
+    std::vector<IndexEntry> synced;
+    {
+        QReadLocker locker(&m_lock);
+        if (m_generation != generation) {
+            abandon();
+            return;
+        }
+        refresh();
+        synced = compacted;
+    }
+    if (!writeHeader(newIndexFd, IndexMagic, fileId)
+        || !pwriteAll(newIndexFd, synced.data(), synced.size() * sizeof(IndexEntry), sizeof(FileHeader))
+        || fdatasync(newDataFd) != 0 || fdatasync(newIndexFd) != 0) {
+        abandon();
+        return;
+    }
+
+    // Phase 2: with appends blocked, pick up what changed since and switch
+    // over to the new files. Only those changes are left to sync.
+    QWriteLocker locker(&m_lock);
+    if (m_generation != generation || !isOpen()) {
+        abandon();
+        return;
+    }
+    for (size_t slot = copiedSlots; slot < m_index.size(); ++slot) {
+        if (!(m_index[slot].flags & DeletedFlag) && !copyRecord(m_index[slot], true)) {
+            abandon();
+            return;
+        }
+    }
+    const quint64 deadBytes = refresh();
+
+    bool written = true;
+    for (size_t slot = 0; slot < compacted.size() && written; ++slot) {
+        if (slot < synced.size() && std::memcmp(&compacted[slot], &synced[slot], sizeof(IndexEntry)) == 0)
+            continue;
+        written = pwriteAll(newIndexFd, &compacted[slot], sizeof(IndexEntry),
+                            sizeof(FileHeader) + slot * sizeof(IndexEntry));
+    }
+    written = written && fdatasync(newDataFd) == 0 && fdatasync(newIndexFd) == 0;
+    // Data first: open() completes the index rename if we stop in between
+    if (!written
+        || ::rename(QFile::encodeName(newDataPath).constData(), QFile::encodeName(dataPath).constData()) != 0) {
+        abandon();
+        return;
+    }
+    ::rename(QFile::encodeName(newIndexPath).constData(), QFile::encodeName(indexPath).constData());
+
+    if (m_map)
+        munmap(const_cast<uchar *>(m_map), m_mapSize);
+    m_map = nullptr;
+    m_mapSize = 0;
+    ::close(m_dataFd);
+    ::close(m_indexFd);
+    m_dataFd = newDataFd;
+    m_indexFd = newIndexFd;
+    m_dataSize = writeOffset;
+    m_index = std::move(compacted);
+    // Everything that was unwritten is in the new files now
+    m_unwritten.clear();
+    m_slotById.clear();
+    for (size_t slot = 0; slot < m_index.size(); ++slot) {
+        if (!(m_index[slot].flags & DeletedFlag))
+            m_slotById.insert(m_index[slot].id, int(slot));
+    }
+    m_liveBytes = writeOffset - sizeof(FileHeader) - deadBytes;
+    m_deadBytes = deadBytes;
+    if (!remap(m_dataSize))
+        close();
+}
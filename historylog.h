@@ -0,0 +1,147 @@
+#pragma once
+
+#include <QByteArray>
+#include <QList>
+#include <QMap>
+#include <QMutex>
+#include <QObject>
+#include <QReadWriteLock>
+#include <QString>
+#include <QThreadPool>
+
+#include <QHash>
+#include <atomic>
+#include <functional>
+#include <vector>
+
+// Append-only on-disk store for the clipboard history.
+//
+// history.dat holds checksummed records (header, label, payload) and is
+// mapped read-only; history.idx is an array of fixed-size entries that
+// point into it. open() only reads the index, payloads are paged in when
+// readPayload() asks for them. Removing an entry flips a flag in its index
+// entry; the dead space is reclaimed by a compaction on a worker thread.
+//
+// append() only updates the index in memory. The same worker writes new
+// records and syncs them in batches, then writes their index entries; until
+// then they are read from memory. A crash loses at most the last batch.
+//
+// readPayload(), payload() and label() may be called from any thread.
+class HistoryLog : public QObject
+{
+    Q_OBJECT
+
+public:
+    enum Type : quint8 {
+        Text = 1,  // UTF-8
+        Image = 2, // ImageCodec stream or TilePool map
+        Tiles = 3, // TilePool tiles, not an entry of their own
+        Originals = 4 // OriginalFormats of the entry with the same contentKey
+    };
+
+    struct Record {
+        quint64 id;
+        Type type;
+        quint64 contentKey;
+        qint64 timestamp;
+        quint64 payloadLength;
+        quint32 lineCount; // Text only; 0 if unknown
+    };
+
+    explicit HistoryLog(QObject *parent = nullptr);
+    ~HistoryLog();
+
+    bool open(const QString &directory);
+    bool isOpen() const { return m_dataFd >= 0; }
+
+    // Live records, least recently copied first
+    QList<Record> records() const;
+
+    // Returns the new record id, or 0 if nothing could be written
+    quint64 append(Type type, const QByteArray &payload, quint64 contentKey, const QString &label,
+                   quint32 lineCount = 0);
+    void remove(quint64 id);
+    // Marks the record as copied again, moving it to the end of records()
+    void touch(quint64 id);
+    void clear();
+
+    QString label(quint64 id) const;
+    // Verifies the record and hands the mapped payload to reader, with
+    // the log locked for reading. Returns false if the record is missing
+    // or damaged.
+    bool readPayload(quint64 id, const std::function<void(const char *, qsizetype)> &reader) const;
+    // The first maxBytes of the payload at most, for previews and headers.
+    // Only the record header is verified: checksumming the whole record
+    // would page all of it in.
+    bool readPayloadPrefix(quint64 id, qsizetype maxBytes,
+                           const std::function<void(const char *, qsizetype)> &reader) const;
+    QByteArray payload(quint64 id) const;
+
+private:
+    // 64 bytes, host byte order. entryCrc covers the bytes before it.
+    struct IndexEntry {
+        quint64 id;
+        quint64 offset;        // Record offset in history.dat
+        quint64 payloadLength;
+        quint64 contentKey;
+        qint64 timestamp;      // Last copied, ms since epoch
+        quint32 labelLength;
+        quint32 recordCrc;     // CRC-32 of label + payload
+        quint8 type;
+        quint8 flags;
+        quint16 reserved0;
+        quint32 lineCount;     // Was reserved: 0 in older entries
+        quint32 reserved2;
+        quint32 entryCrc;
+    };
+
+    void close();
+    bool remap(quint64 minimumSize);
+    bool validate();
+    bool readIndexEntry(int slot, IndexEntry *entry) const;
+    bool writeIndexEntry(int slot, const IndexEntry &entry);
+    bool recordIsIntact(const IndexEntry &entry) const;
+    bool headerIsIntact(const IndexEntry &entry) const;
+    qint64 nextTimestamp();
+    // Writes and syncs the unwritten records, then their index entries
+    void flush();
+    void scheduleCompaction();
+    void compact();
+
+    // An appended record not on disk yet
+    struct Unwritten {
+        int slot = 0;
+        quint64 offset = 0;
+        QByteArray header; // The on-disk record header
+        QByteArray label;  // UTF-8
+        QByteArray payload;
+    };
+    // Fills in the CRC of a record's label and payload, on m_worker so that
+    // append() does not checksum on the caller's thread. Returns it.
+    static quint32 seal(Unwritten *record);
+
+    QString m_directory;
+    int m_dataFd = -1;
+    int m_indexFd = -1;
+    const uchar *m_map = nullptr;
+    quint64 m_mapSize = 0;
+    quint64 m_dataSize = 0;
+
+    std::vector<IndexEntry> m_index;
+    QHash<quint64, int> m_slotById;
+    QMap<quint64, Unwritten> m_unwritten; // By id, so in append order
+    bool m_flushScheduled = false;
+    quint64 m_nextId = 1;
+    qint64 m_lastTimestamp = 0; // Timestamps are kept strictly increasing
+    quint64 m_liveBytes = 0;
+    quint64 m_deadBytes = 0;
+    quint64 m_generation = 0; // Bumped by clear(), aborts a running compaction
+
+    // Guards everything above; readers take it for reading only
+    mutable QReadWriteLock m_lock;
+    // Held by flush() while it writes, so that clear() never truncates
+    // under it. Taken before m_lock.
+    QMutex m_fileMutex;
+    QThreadPool m_worker; // Flushes and compaction, one at a time
+    std::atomic<bool> m_compacting { false };
+};
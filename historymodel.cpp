@@ -0,0 +1,591 @@
+#include "historymodel.h"
+#include "contenthash.h"
+#include "historylog.h"
+#include "imagecache.h"
+#include "imagecodec.h"
+#include "searchindex.h"
+#include "thumbnailcache.h"
+#include "tilepool.h"
+#include "trace.h"
+
+#include <QDateTime>
+#include <QImage>
+#include <QLocale>
+#include <QStringList>
+
+namespace {
+
+// Persisted texts are handed to the search index in batches of this size
+constexpr int IndexBatchSize = 1000;
+
+// Decodes a compressed image, or assembles it from its tiles, from memory
+// or straight from the log's mapping. Safe to call from worker threads.
+QImage loadImage(const HistoryLog *log, const TilePool *tiles, quint64 logId, const QByteArray &compressed)
+{
+    if (!compressed.isEmpty())
+        return TilePool::isTileMap(compressed) ? tiles->assemble(compressed) : ImageCodec::decompress(compressed);
+
+    QImage image;
+    QByteArray map;
+    if (logId != 0) {
+        log->readPayload(logId, [&](const char *data, qsizetype size) {
+            if (TilePool::isTileMap(data, size))
+                map = QByteArray(data, size);
+            else
+                image = ImageCodec::decompress(data, size);
+        });
+    }
+    // Tiles are read from the log too, so not while it is locked here
+    return map.isEmpty() ? image : tiles->assemble(map);
+}
+
+// Reads a persisted text back for the search of what is not indexed
+SearchIndex::TextReader logReader(const HistoryLog *log, quint64 logId)
+{
+    return [log, logId]() {
+        QString text;
+        log->readPayload(logId, [&text](const char *data, qsizetype size) {
+            text = QString::fromUtf8(data, size);
+        });
+        return text;
+    };
+}
+
+} // namespace
+
+HistoryModel::HistoryModel(QObject *parent)
+    : QAbstractListModel(parent)
+    , m_thumbnails(new ThumbnailCache(this)) // Created first: its workers read from m_log
+    , m_search(new SearchIndex(this))        // Likewise
+    , m_log(new HistoryLog(this))
+    , m_images(std::make_shared<ImageCache>(DefaultImageCacheBytes))
+    , m_tiles(std::make_shared<TilePool>(m_log))
+{
+    connect(m_thumbnails, &ThumbnailCache::thumbnailReady, this, &HistoryModel::onThumbnailReady);
+    m_worker.setMaxThreadCount(1);
+}
+
+HistoryModel::~HistoryModel()
+{
+    // Results still in flight are posted to this object and dropped with it
+    m_worker.clear();
+    m_worker.waitForDone();
+}
+
+bool HistoryModel::openStorage(const QString &directory)
+{
+    if (!m_log->open(directory))
+        return false;
+
+    // Only index data is loaded here; labels and payloads stay on disk, and
+    // the tile pool is rebuilt on the worker
+    const QList<HistoryLog::Record> records = m_log->records();
+    QList<HistoryLog::Record> tileRecords;
+    QList<HistoryLog::Record> imageRecords;
+    QList<HistoryLog::Record> originalRecords;
+    beginResetModel();
+    m_store.clear();
+    m_pendingImages.clear();
+    m_originals.clear();
+    m_store.reserve(int(records.size()));
+    // Oldest first, so a newer duplicate shadows an older one
+    for (const HistoryLog::Record &logRecord : records) {
+        if (logRecord.type == HistoryLog::Tiles) {
+            tileRecords.append(logRecord);
+            continue;
+        }
+        if (logRecord.type == HistoryLog::Originals) {
+            originalRecords.append(logRecord);
+            continue;
+        }
+        if (logRecord.type == HistoryLog::Image)
+            imageRecords.append(logRecord);
+
+        HistoryStore::Record record;
+        record.kind = logRecord.type == HistoryLog::Image ? HistoryStore::Image : HistoryStore::Text;
+        record.contentKey = logRecord.contentKey;
+        record.timestamp = logRecord.timestamp;
+        record.logId = logRecord.id;
+        record.storedBytes = qint64(logRecord.payloadLength);
+        if (record.kind == HistoryStore::Text) {
+            record.lineCount = logRecord.lineCount;
+            record.textBytes = qint64(logRecord.payloadLength);
+        }
+        m_store.prepend(record);
+    }
+    endResetModel();
+
+    // Newest first, so each entry keeps its latest formats. Older records,
+    // and those of entries no longer there, are left over from a crash.
+    for (auto it = originalRecords.crbegin(); it != originalRecords.crend(); ++it) {
+        const Id id = m_store.find(it->contentKey);
+        if (id != 0 && !m_originals.contains(id))
+            m_originals.insert(id, { QByteArray(), it->id });
+        else
+            m_log->remove(it->id);
+    }
+
+    // Reading every Tiles directory and image map grows with the history,
+    // so it is done on the worker, before any image is split there. The
+    // tiles released by trimming meanwhile are dropped once it is done.
+    m_tiles->beginRestore();
+    m_worker.start([tiles = m_tiles, tileRecords, imageRecords]() {
+        tiles->restore(tileRecords, imageRecords);
+    });
+    trimToMaxEntries();
+
+    // Only the start of each text is indexed. Reading and decoding it is
+    // left to the worker so that opening a large history stays fast.
+    QList<QPair<quint64, quint64>> texts; // (fingerprint, log id)
+    for (int row = 0; row < m_store.size(); ++row) {
+        const Id id = m_store.idAt(row);
+        if (m_store.kind(id) == HistoryStore::Text && m_store.logId(id) != 0)
+            texts.append({ m_store.contentKey(id), m_store.logId(id) });
+    }
+    m_search->clear();
+    m_worker.start([this, log = m_log, texts]() {
+        QList<QPair<quint64, QString>> batch;
+        for (const auto &text : texts) {
+            // Enough bytes for one character more than IndexedLength in any
+            // script, so that the index can tell the longer texts, and only
+            // those are paged in
+            log->readPayloadPrefix(text.second, qsizetype(SearchIndex::IndexedLength + 1) * 4,
+                                   [&](const char *data, qsizetype size) {
+                batch.append({ text.first, QString::fromUtf8(data, size) });
+            });
+            if (batch.size() == IndexBatchSize || &text == &texts.last()) {
+                QMetaObject::invokeMethod(this, [this, batch]() { onTextsLoaded(batch); }, Qt::QueuedConnection);
+                batch.clear();
+            }
+        }
+    });
+    return true;
+}
+
+int HistoryModel::rowCount(const QModelIndex &parent) const
+{
+    return parent.isValid() ? 0 : m_store.size();
+}
+
+QVariant HistoryModel::data(const QModelIndex &index, int role) const
+{
+    if (!index.isValid() || index.row() >= m_store.size())
+        return QVariant();
+
+    const Id id = m_store.idAt(index.row());
+    const bool image = m_store.kind(id) == HistoryStore::Image;
+    switch (role) {
+    case Qt::DisplayRole:
+        if (m_store.label(id).isNull() && m_store.logId(id) != 0) {
+            const QString label = m_log->label(m_store.logId(id));
+            m_store.setLabel(id, label.isNull() ? QStringLiteral("") : label); // Loaded, just empty
+        }
+        return m_store.label(id);
+    case Qt::DecorationRole: {
+        if (!image)
+            return QVariant();
+        return m_thumbnails->thumbnail(m_store.contentKey(id), imageLoaderAt(index.row()));
+    }
+    case Qt::ToolTipRole: {
+        if (image)
+            return QVariant();
+        QStringList parts;
+        const quint32 lineCount = m_store.lineCount(id);
+        if (lineCount > 0)
+            parts << (lineCount == 1 ? QString("1 line") : QString("%1 lines").arg(lineCount));
+        if (m_store.textBytes(id) > 0)
+            parts << QLocale().formattedDataSize(m_store.textBytes(id));
+        return parts.isEmpty() ? QVariant() : QVariant(parts.join(", "));
+    }
+    case ContentRole:
+        return contentAt(index.row());
+    default:
+        return QVariant();
+    }
+}
+
+QVariant HistoryModel::contentAt(int row) const
+{
+    const Id id = m_store.idAt(row);
+    const HistoryStore::Payload *payload = m_store.payload(id);
+
+    if (m_store.kind(id) == HistoryStore::Text) {
+        if (payload)
+            return payload->compressed.isEmpty() ? payload->text : QString::fromUtf8(qUncompress(payload->compressed));
+        return m_store.logId(id) != 0 ? QString::fromUtf8(m_log->payload(m_store.logId(id))) : QString();
+    }
+
+    const quint64 key = m_store.contentKey(id);
+    QImage image = m_pendingImages.value(id);
+    if (image.isNull())
+        image = m_images->find(key);
+    if (image.isNull()) {
+        image = loadImage(m_log, m_tiles.get(), m_store.logId(id), payload ? payload->compressed : QByteArray());
+        m_images->insert(key, image);
+    }
+    return image.isNull() ? QVariant() : QVariant(image);
+}
+
+std::function<QImage()> HistoryModel::imageLoaderAt(int row) const
+{
+    const Id id = m_store.idAt(row);
+    const HistoryStore::Payload *payload = m_store.payload(id);
+    return [images = m_images, tiles = m_tiles, log = m_log, logId = m_store.logId(id), key = m_store.contentKey(id),
+            compressed = payload ? payload->compressed : QByteArray(), pending = m_pendingImages.value(id)]() {
+        if (!pending.isNull())
+            return pending;
+        const QImage cached = images->find(key);
+        return cached.isNull() ? loadImage(log, tiles.get(), logId, compressed) : cached;
+    };
+}
+
+QByteArray HistoryModel::utf8TextAt(int row) const
+{
+    const Id id = m_store.idAt(row);
+    if (m_store.kind(id) != HistoryStore::Text)
+        return QByteArray();
+    const HistoryStore::Payload *payload = m_store.payload(id);
+    if (!payload)
+        return m_store.logId(id) != 0 ? m_log->payload(m_store.logId(id)) : QByteArray();
+    return payload->compressed.isEmpty() ? payload->text.toUtf8() : qUncompress(payload->compressed);
+}
+
+HistoryModel::EntryInfo HistoryModel::entryInfo(int row) const
+{
+    const Id id = m_store.idAt(row);
+    EntryInfo info;
+    info.contentKey = m_store.contentKey(id);
+    info.image = m_store.kind(id) == HistoryStore::Image;
+    info.label = data(index(row), Qt::DisplayRole).toString();
+    info.lineCount = m_store.lineCount(id);
+    info.bytes = info.image ? m_store.storedBytes(id) : m_store.textBytes(id);
+    return info;
+}
+
+quint64 HistoryModel::contentKeyAt(int row) const
+{
+    return m_store.contentKey(m_store.idAt(row));
+}
+
+OriginalFormats::List HistoryModel::originalFormatsAt(int row) const
+{
+    const auto originals = m_originals.constFind(m_store.idAt(row));
+    if (originals == m_originals.cend())
+        return OriginalFormats::List();
+    if (originals->logId == 0)
+        return OriginalFormats::deserialize(originals->data);
+
+    OriginalFormats::List formats;
+    m_log->readPayload(originals->logId, [&formats](const char *data, qsizetype size) {
+        formats = OriginalFormats::deserialize(data, size);
+    });
+    return formats;
+}
+
+void HistoryModel::prepend(const QVariant &content, const OriginalFormats::List &originals)
+{
+    prepend(CapturedContent::prepare(content), originals);
+}
+
+void HistoryModel::prepend(const CapturedContent &captured, const OriginalFormats::List &originals)
+{
+    const qint64 started = Trace::now();
+    const quint64 contentKey = captured.contentKey;
+    const qint64 timestamp = QDateTime::currentMSecsSinceEpoch();
+
+    // Re-copying anything already in the history just moves it up
+    const Id existing = m_store.find(contentKey);
+    if (existing != 0) {
+        moveToFront(existing, timestamp);
+        if (!originals.isEmpty())
+            setOriginals(existing, originals);
+        emit entryPrepended(contentKey);
+        return;
+    }
+    if (contentKey == 0)
+        return; // Neither text nor image
+    // Only known by its fingerprint, but no longer in the history
+    if (!captured.prepared) {
+        prepend(CapturedContent::prepare(captured.content), originals);
+        return;
+    }
+
+    HistoryStore::Record record;
+    record.contentKey = contentKey;
+    record.timestamp = timestamp;
+    record.label = captured.label;
+    HistoryStore::PayloadPtr payload;
+    QImage image;
+    bool compressLater = false;
+
+    if (captured.content.typeId() == QMetaType::QImage) {
+        image = captured.content.value<QImage>();
+        record.kind = HistoryStore::Image;
+    } else {
+        const QString text = captured.content.toString();
+        record.lineCount = captured.lineCount;
+
+        // Once the log has it, the payload no longer needs to stay in memory
+        record.logId = m_log->isOpen()
+            ? m_log->append(HistoryLog::Text, captured.utf8, contentKey, record.label, record.lineCount) : 0;
+        if (record.logId != 0) {
+            record.storedBytes = record.textBytes = captured.utf8.size();
+        } else {
+            payload = std::make_unique<HistoryStore::Payload>();
+            payload->text = text;
+            record.storedBytes = text.size() * qint64(sizeof(QChar));
+            record.textBytes = captured.utf8.size();
+            if (text.size() > CompactTextLength)
+                compressLater = true; // Held as UTF-16 only until the worker has compressed it
+        }
+    }
+
+    beginInsertRows(QModelIndex(), 0, 0);
+    const Id id = m_store.prepend(record, std::move(payload));
+    endInsertRows();
+    if (record.kind == HistoryStore::Text) {
+        const QString text = captured.content.toString();
+        // Memory-only texts are shared with the payload until compressed
+        SearchIndex::TextReader reader = [text]() { return text; };
+        if (record.logId != 0)
+            reader = logReader(m_log, record.logId);
+        m_search->add(contentKey, m_store.order(id), text, reader);
+    }
+    if (!originals.isEmpty())
+        setOriginals(id, originals);
+
+    if (!image.isNull()) {
+        // Held decoded only until the worker has compressed it
+        m_pendingImages.insert(id, image);
+        m_worker.start([this, id, image, tiles = m_tiles]() {
+            const qint64 compressStarted = Trace::now();
+            const TilePool::Split split = tiles->split(image);
+            // What the image adds: its map and the tiles not seen before
+            qint64 addedBytes = split.map.size();
+            for (const QByteArray &tile : split.newTiles)
+                addedBytes += tile.size();
+            Trace::record(Trace::StoreImage, compressStarted, Trace::now(), addedBytes);
+            QMetaObject::invokeMethod(this, [this, id, split]() {
+                onImageCompressed(id, split);
+            }, Qt::QueuedConnection);
+        });
+    } else if (compressLater) {
+        m_worker.start([this, id, utf8 = captured.utf8]() {
+            const qint64 compressStarted = Trace::now();
+            // The fastest level: logs and code still shrink several times over
+            const QByteArray compressed = qCompress(utf8, 1);
+            Trace::record(Trace::StoreText, compressStarted, Trace::now(), compressed.size());
+            QMetaObject::invokeMethod(this, [this, id, compressed, textBytes = qint64(utf8.size())]() {
+                onTextCompressed(id, compressed, textBytes);
+            }, Qt::QueuedConnection);
+        });
+    }
+
+    trimToMaxEntries();
+    // Images and long memory-only texts are recorded once compressed
+    if (record.kind == HistoryStore::Text && !compressLater)
+        Trace::record(Trace::StoreText, started, Trace::now(), record.storedBytes);
+    emit entryPrepended(contentKey);
+}
+
+void HistoryModel::onImageCompressed(Id id, const TilePool::Split &split)
+{
+    // The entry may have been evicted or cleared in the meantime; its id
+    // is then no longer valid
+    const auto pending = m_pendingImages.constFind(id);
+    if (pending == m_pendingImages.cend())
+        return;
+    const QImage image = *pending;
+    m_pendingImages.erase(pending);
+    if (split.map.isEmpty() || !m_store.contains(id))
+        return;
+
+    const quint64 contentKey = m_store.contentKey(id);
+    // The freshly copied image is the most likely one to be pasted again
+    m_images->insert(contentKey, image);
+
+    // The log must not refer to tiles that are only in memory
+    const bool tilesStored = m_tiles->add(split, image);
+    const quint64 logId = m_log->isOpen() && tilesStored
+        ? m_log->append(HistoryLog::Image, split.map, contentKey, m_store.label(id)) : 0;
+    m_store.setLogId(id, logId);
+    m_store.setStoredBytes(id, split.compressedBytes);
+    if (logId == 0) {
+        auto payload = std::make_unique<HistoryStore::Payload>();
+        payload->compressed = split.map;
+        m_store.setPayload(id, std::move(payload));
+        return;
+    }
+
+    // Appending made this the newest record on disk. Entries copied after
+    // it were written first, so touch them to keep the log's order in
+    // line with the model's.
+    for (int above = m_store.rowOf(id) - 1; above >= 0; --above) {
+        const quint64 aboveLogId = m_store.logId(m_store.idAt(above));
+        if (aboveLogId != 0)
+            m_log->touch(aboveLogId);
+    }
+}
+
+void HistoryModel::setOriginals(Id id, const OriginalFormats::List &originals)
+{
+    removeOriginals(id);
+    Originals stored;
+    stored.data = OriginalFormats::serialize(originals);
+    if (m_log->isOpen())
+        stored.logId = m_log->append(HistoryLog::Originals, stored.data, m_store.contentKey(id), QString());
+    if (stored.logId != 0)
+        stored.data.clear();
+    m_originals.insert(id, stored);
+}
+
+void HistoryModel::removeOriginals(Id id)
+{
+    const auto originals = m_originals.constFind(id);
+    if (originals == m_originals.cend())
+        return;
+    if (originals->logId != 0)
+        m_log->remove(originals->logId);
+    m_originals.erase(originals);
+}
+
+void HistoryModel::onTextCompressed(Id id, const QByteArray &compressed, qint64 textBytes)
+{
+    // The entry may have been evicted or cleared in the meantime
+    if (compressed.isEmpty() || !m_store.contains(id) || !m_store.payload(id))
+        return;
+
+    auto payload = std::make_unique<HistoryStore::Payload>();
+    payload->compressed = compressed;
+    m_store.setPayload(id, std::move(payload));
+    m_store.setStoredBytes(id, compressed.size());
+    m_store.setTextBytes(id, textBytes);
+    m_search->setReader(m_store.contentKey(id), [compressed]() {
+        return QString::fromUtf8(qUncompress(compressed));
+    });
+}
+
+void HistoryModel::clear()
+{
+    beginResetModel();
+    m_store.clear();
+    m_pendingImages.clear();
+    m_originals.clear();
+    m_images->clear();
+    m_tiles->clear();
+    m_search->clear();
+    m_log->clear();
+    endResetModel();
+}
+
+void HistoryModel::setMaxEntries(int maxEntries)
+{
+    m_maxEntries = qBound(1, maxEntries, MaxEntriesLimit);
+    trimToMaxEntries();
+}
+
+void HistoryModel::setImageCacheBudget(qint64 bytes)
+{
+    m_images->setBudget(qsizetype(qMax<qint64>(0, bytes)));
+}
+
+HistoryModel::MemoryStats HistoryModel::memoryStats() const
+{
+    MemoryStats stats;
+    for (int row = 0; row < m_store.size(); ++row) {
+        const Id id = m_store.idAt(row);
+        if (m_store.kind(id) == HistoryStore::Image) {
+            ++stats.imageEntries;
+            const auto pending = m_pendingImages.constFind(id);
+            if (pending != m_pendingImages.cend())
+                stats.pendingImageBytes += pending->sizeInBytes();
+            else
+                stats.compressedImageBytes += m_store.storedBytes(id);
+        } else {
+            ++stats.textEntries;
+            stats.textBytes += m_store.storedBytes(id);
+        }
+    }
+    // Entries count their tiles as if they had them to themselves
+    const TilePool::Stats tiles = m_tiles->stats();
+    stats.sharedTileSavings = tiles.referencedBytes - tiles.storedBytes;
+    stats.compressedImageBytes -= stats.sharedTileSavings;
+    stats.imageTiles = tiles.tiles;
+    stats.decodedImageBytes = m_images->decodedBytes();
+    stats.decodedImageBudget = m_images->budget();
+    stats.recordBytes = m_store.recordBytes();
+    stats.persistent = m_log->isOpen();
+    return stats;
+}
+
+void HistoryModel::trimToMaxEntries()
+{
+    const int count = m_store.size();
+    if (count <= m_maxEntries)
+        return;
+
+    beginRemoveRows(QModelIndex(), m_maxEntries, count - 1);
+    for (int row = m_maxEntries; row < count; ++row) {
+        const Id id = m_store.idAt(row);
+        const quint64 contentKey = m_store.contentKey(id);
+        const quint64 logId = m_store.logId(id);
+        if (m_store.kind(id) == HistoryStore::Image) {
+            m_images->remove(contentKey);
+            m_pendingImages.remove(id);
+            const HistoryStore::Payload *payload = m_store.payload(id);
+            const QByteArray map = payload ? payload->compressed : logId != 0 ? m_log->payload(logId) : QByteArray();
+            if (TilePool::isTileMap(map))
+                m_tiles->release(map);
+        }
+        if (logId != 0)
+            m_log->remove(logId);
+        removeOriginals(id);
+        if (m_store.find(contentKey) == id)
+            m_search->remove(contentKey);
+    }
+    m_store.truncate(m_maxEntries);
+    endRemoveRows();
+}
+
+void HistoryModel::moveToFront(Id id, qint64 timestamp)
+{
+    const int row = m_store.rowOf(id);
+    if (row < 0)
+        return;
+
+    if (row > 0)
+        beginMoveRows(QModelIndex(), row, row, QModelIndex(), 0);
+    m_store.moveToFront(id, timestamp);
+    if (row > 0)
+        endMoveRows();
+
+    if (m_store.kind(id) == HistoryStore::Text)
+        m_search->setOrder(m_store.contentKey(id), m_store.order(id));
+    if (m_store.logId(id) != 0)
+        m_log->touch(m_store.logId(id));
+}
+
+int HistoryModel::rowForKey(quint64 contentKey) const
+{
+    const Id id = m_store.find(contentKey);
+    return id != 0 ? m_store.rowOf(id) : -1;
+}
+
+void HistoryModel::onThumbnailReady()
+{
+    // Thumbnails are only requested for painted rows, and the view only
+    // repaints what is visible, so a full-range notification is cheap.
+    if (!m_store.isEmpty())
+        emit dataChanged(index(0), index(m_store.size() - 1), { Qt::DecorationRole });
+}
+
+void HistoryModel::onTextsLoaded(const QList<QPair<quint64, QString>> &texts)
+{
+    // Entries evicted or cleared since the load started are skipped; the
+    // current order is used in case an entry was moved up meanwhile
+    for (const auto &text : texts) {
+        const Id id = m_store.find(text.first);
+        if (id != 0)
+            m_search->add(text.first, m_store.order(id), text.second, logReader(m_log, m_store.logId(id)));
+    }
+}
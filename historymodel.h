@@ -0,0 +1,170 @@
+#pragma once
+
+#include "capturedcontent.h"
+#include "historystore.h"
+#include "originalformats.h"
+#include "tilepool.h"
+
+#include <QAbstractListModel>
+#include <QByteArray>
+#include <QHash>
+#include <QImage>
+#include <QList>
+#include <QPair>
+#include <QString>
+#include <QThreadPool>
+#include <QVariant>
+
+#include <functional>
+#include <memory>
+
+class HistoryLog;
+class ImageCache;
+class SearchIndex;
+class ThumbnailCache;
+
+// List model over the clipboard history, newest entry first. The entries
+// themselves are records in a HistoryStore; this adds the model/view,
+// persistence, caches and workers around it.
+// Labels are computed once when the entry is added; image thumbnails are
+// requested lazily from the ThumbnailCache for the rows actually painted.
+// With storage opened, entries are written to a HistoryLog and their
+// payload is only read back from disk when it is needed.
+//
+// Every entry is fingerprinted once when it is added; copying content that
+// is already in the history moves that entry to the front instead.
+//
+// Images are split into tiles on a worker right after capture and only
+// kept compressed (on disk or in memory), each distinct tile once in a
+// TilePool, so a burst of similar screenshots costs about one image plus
+// what changed. Decoded bitmaps live in an ImageCache bounded by a byte
+// budget and are assembled again on demand.
+//
+// Text entries keep a preview made in one scan at capture: the start of
+// the first line and the line count. The full text lives in the log, or
+// for memory-only entries past CompactTextLength as zlib-compressed UTF-8,
+// and is only materialized by contentAt().
+//
+// Text entries are kept in a SearchIndex keyed by their fingerprint; results
+// are mapped back to rows with rowForKey(). The index reads the rest of long
+// texts back from the log or from memory when it scans them.
+//
+// The OriginalFormats an entry was copied in are kept serialized next to
+// it (in the log when it is open) and only read back when it is activated.
+class HistoryModel : public QAbstractListModel
+{
+    Q_OBJECT
+
+public:
+    enum Roles {
+        ContentRole = Qt::UserRole // The full QVariant (QString or QImage)
+    };
+
+    // What the control socket lists about an entry
+    struct EntryInfo {
+        quint64 contentKey = 0;
+        bool image = false;
+        QString label;
+        quint32 lineCount = 0; // Text only; 0 if unknown
+        qint64 bytes = 0;      // UTF-8 size of a text, compressed size of an image
+    };
+
+    struct MemoryStats {
+        int textEntries = 0;
+        int imageEntries = 0;
+        qint64 textBytes = 0;            // Stored text (UTF-8 on disk; compressed or UTF-16 in memory)
+        qint64 compressedImageBytes = 0; // Images at rest, on disk or in memory, shared tiles once
+        qint64 sharedTileSavings = 0;    // What sharing tiles saves on top of that
+        int imageTiles = 0;              // Distinct tiles
+        qint64 pendingImageBytes = 0;    // Decoded images still waiting for compression
+        qint64 decodedImageBytes = 0;    // Decoded image cache
+        qint64 decodedImageBudget = 0;
+        qint64 recordBytes = 0;          // The entry records themselves
+        bool persistent = false;
+    };
+
+    static constexpr int DefaultMaxEntries = 10000;
+    static constexpr int MaxEntriesLimit = 100000;
+    static constexpr int MaxLabelLength = CapturedContent::MaxLabelLength;
+    static constexpr qint64 DefaultImageCacheBytes = 256LL * 1024 * 1024;
+    // Memory-only texts longer than this (in characters) are kept compressed
+    static constexpr qsizetype CompactTextLength = 2048;
+
+    explicit HistoryModel(QObject *parent = nullptr);
+    ~HistoryModel();
+
+    // Loads the persisted history from directory and keeps it up to date
+    bool openStorage(const QString &directory);
+
+    int rowCount(const QModelIndex &parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
+
+    // Inserts at row 0 (or moves an identical entry there) and evicts
+    // from the tail beyond maxEntries(). Non-empty originals replace those
+    // of an identical entry.
+    void prepend(const CapturedContent &captured, const OriginalFormats::List &originals = {});
+    // Prepares content on the calling thread first
+    void prepend(const QVariant &content, const OriginalFormats::List &originals = {});
+    void clear();
+
+    bool isEmpty() const { return m_store.isEmpty(); }
+    // Materializes the payload, reading and decoding it if needed
+    QVariant contentAt(int row) const;
+    // Reads and decodes an image entry like contentAt(), but on whatever
+    // thread it is called from: everything it needs is captured by value
+    std::function<QImage()> imageLoaderAt(int row) const;
+    // A text entry as UTF-8, straight from the log when it is there
+    QByteArray utf8TextAt(int row) const;
+    EntryInfo entryInfo(int row) const;
+    quint64 contentKeyAt(int row) const;
+    OriginalFormats::List originalFormatsAt(int row) const;
+
+    int maxEntries() const { return m_maxEntries; }
+    void setMaxEntries(int maxEntries);
+    void setImageCacheBudget(qint64 bytes);
+
+    MemoryStats memoryStats() const;
+
+    SearchIndex *searchIndex() const { return m_search; }
+    // Row of the entry with this fingerprint, or -1
+    int rowForKey(quint64 contentKey) const;
+    const HistoryStore &store() const { return m_store; }
+
+signals:
+    // After prepend() has put content at row 0, new or moved
+    void entryPrepended(quint64 contentKey);
+
+private:
+    using Id = HistoryStore::Id;
+
+    // Serialized OriginalFormats, in memory or a log record
+    struct Originals {
+        QByteArray data;
+        quint64 logId = 0;
+    };
+
+    void setOriginals(Id id, const OriginalFormats::List &originals);
+    void removeOriginals(Id id);
+    void trimToMaxEntries();
+    void moveToFront(Id id, qint64 timestamp);
+    void onImageCompressed(Id id, const TilePool::Split &split);
+    void onTextCompressed(Id id, const QByteArray &compressed, qint64 textBytes);
+    void onThumbnailReady();
+    void onTextsLoaded(const QList<QPair<quint64, QString>> &texts);
+
+    // Entries, found by fingerprint. A 64-bit hash makes collisions
+    // negligible at 100k entries.
+    HistoryStore m_store;
+    // Decoded images held only until the worker has compressed them
+    QHash<Id, QImage> m_pendingImages;
+    // Only entries that were copied with any
+    QHash<Id, Originals> m_originals;
+    ThumbnailCache *m_thumbnails;
+    SearchIndex *m_search;
+    HistoryLog *m_log;
+    // Shared with thumbnail workers, which may outlive a model teardown
+    std::shared_ptr<ImageCache> m_images;
+    std::shared_ptr<TilePool> m_tiles;
+    QThreadPool m_worker; // Compression and index loading, in order
+    int m_maxEntries = DefaultMaxEntries;
+};
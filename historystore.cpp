@@ -0,0 +1,152 @@
+#include "historystore.h"
+
+#include <algorithm>
+
+void HistoryStore::reserve(int entries)
+{
+    const size_t count = size_t(qMax(0, entries));
+    m_kinds.reserve(count);
+    m_generations.reserve(count);
+    m_orders.reserve(count);
+    m_contentKeys.reserve(count);
+    m_timestamps.reserve(count);
+    m_logIds.reserve(count);
+    m_storedBytes.reserve(count);
+    m_textBytes.reserve(count);
+    m_lineCounts.reserve(count);
+    m_labels.reserve(count);
+    m_payloads.reserve(count);
+    m_rows.reserve(count);
+    m_idByKey.reserve(qsizetype(count));
+}
+
+int HistoryStore::rowOf(Id id) const
+{
+    const qint64 slot = slotOf(id);
+    if (slot < 0)
+        return -1;
+    // Rows are sorted by ascending order from the oldest, so this is a binary search
+    const quint64 order = m_orders[size_t(slot)];
+    const auto it = std::lower_bound(m_rows.cbegin(), m_rows.cend(), order,
+                                     [this](quint32 row, quint64 value) { return m_orders[row] < value; });
+    if (it == m_rows.cend() || *it != quint32(slot))
+        return -1;
+    return int(m_rows.cend() - it) - 1;
+}
+
+HistoryStore::Id HistoryStore::prepend(const Record &record, PayloadPtr payload)
+{
+    quint32 slot;
+    if (!m_freeSlots.empty()) {
+        slot = m_freeSlots.back();
+        m_freeSlots.pop_back();
+    } else {
+        slot = quint32(m_kinds.size());
+        m_kinds.push_back(Free);
+        m_generations.push_back(1);
+        m_orders.push_back(0);
+        m_contentKeys.push_back(0);
+        m_timestamps.push_back(0);
+        m_logIds.push_back(0);
+        m_storedBytes.push_back(0);
+        m_textBytes.push_back(0);
+        m_lineCounts.push_back(0);
+        m_labels.emplace_back();
+        m_payloads.emplace_back();
+    }
+
+    m_kinds[slot] = record.kind;
+    m_orders[slot] = m_nextOrder++;
+    m_contentKeys[slot] = record.contentKey;
+    m_timestamps[slot] = record.timestamp;
+    m_logIds[slot] = record.logId;
+    m_storedBytes[slot] = record.storedBytes;
+    m_textBytes[slot] = record.textBytes;
+    m_lineCounts[slot] = record.lineCount;
+    m_labels[slot] = record.label;
+    m_payloads[slot] = std::move(payload);
+    m_rows.push_back(slot);
+
+    const Id id = idOfSlot(slot);
+    if (record.contentKey != 0)
+        m_idByKey.insert(record.contentKey, id);
+    return id;
+}
+
+int HistoryStore::moveToFront(Id id, qint64 timestamp)
+{
+    const int row = rowOf(id);
+    if (row < 0)
+        return -1;
+
+    const size_t slot = this->slot(id);
+    if (row > 0) {
+        const auto position = m_rows.end() - 1 - row;
+        std::rotate(position, position + 1, m_rows.end());
+    }
+    m_orders[slot] = m_nextOrder++;
+    m_timestamps[slot] = timestamp;
+    if (m_contentKeys[slot] != 0)
+        m_idByKey.insert(m_contentKeys[slot], id);
+    return row;
+}
+
+void HistoryStore::truncate(int row)
+{
+    if (row < 0 || row >= size())
+        return;
+    // The rows to drop are the oldest, at the front
+    const auto end = m_rows.begin() + (size() - row);
+    for (auto it = m_rows.begin(); it != end; ++it)
+        release(*it);
+    m_rows.erase(m_rows.begin(), end);
+}
+
+void HistoryStore::clear()
+{
+    for (quint32 slot : m_rows)
+        release(slot);
+    m_rows.clear();
+    m_idByKey.clear();
+}
+
+qint64 HistoryStore::recordBytes() const
+{
+    const size_t slotCount = m_kinds.capacity();
+    qint64 bytes = qint64(slotCount) * qint64(sizeof(quint8) + sizeof(quint32) + sizeof(quint64) * 3
+                                              + sizeof(qint64) * 3 + sizeof(quint32)
+                                              + sizeof(QString) + sizeof(PayloadPtr));
+    bytes += qint64(m_rows.capacity() + m_freeSlots.capacity()) * qint64(sizeof(quint32));
+    // A QHash node is the key, the value and about a pointer of overhead
+    bytes += m_idByKey.capacity() * qint64(sizeof(quint64) + sizeof(Id) + sizeof(void *));
+    for (quint32 slot : m_rows) {
+        if (!m_labels[slot].isNull())
+            bytes += m_labels[slot].capacity() * qint64(sizeof(QChar));
+        if (m_payloads[slot])
+            bytes += qint64(sizeof(Payload));
+    }
+    return bytes;
+}
+
+qint64 HistoryStore::slotOf(Id id) const
+{
+    const size_t slot = size_t(id & SlotMask);
+    if (id == 0 || slot >= m_kinds.size() || m_kinds[slot] == Free || m_generations[slot] != quint32(id >> 32))
+        return -1;
+    return qint64(slot);
+}
+
+void HistoryStore::release(quint32 slot)
+{
+    const quint64 key = m_contentKeys[slot];
+    if (key != 0 && m_idByKey.value(key) == idOfSlot(slot))
+        m_idByKey.remove(key);
+
+    m_kinds[slot] = Free;
+    // Generation 0 would allow an id of 0
+    if (++m_generations[slot] == 0)
+        m_generations[slot] = 1;
+    m_labels[slot] = QString();
+    m_payloads[slot].reset();
+    m_freeSlots.push_back(slot);
+}
@@ -0,0 +1,136 @@
+#pragma once
+
+#include <QByteArray>
+#include <QHash>
+#include <QString>
+
+#include <memory>
+#include <vector>
+
+// The history's entry records, independent of any UI: QtCore only, no
+// QObject, no model/view. HistoryModel is a list model over it.
+//
+// Records are kept as a struct of arrays indexed by slot, so a scan over
+// one field (sizes for the stats, orders for a lookup) touches only that
+// field, and an entry costs a fixed number of bytes plus its label. Freed
+// slots are reused.
+//
+// Entries are referred to by Id, which stays valid while the entry exists
+// and is never handed out again: a slot's generation is bumped when it is
+// freed. Rows (newest first) are a view over the slots, sorted by a
+// recency order, so rowOf() is a binary search.
+//
+// Payloads held in memory are move-only and only allocated for entries
+// that need them; entries kept in the HistoryLog hold its record id
+// instead.
+class HistoryStore
+{
+public:
+    // Slot in the low 32 bits, generation (from 1) in the high 32 bits;
+    // 0 is none
+    using Id = quint64;
+
+    enum Kind : quint8 {
+        Free,
+        Text,
+        Image
+    };
+
+    // Content not (or not yet) in the log
+    struct Payload {
+        QString text;          // Text, until compressed if long
+        QByteArray compressed; // zlib'd UTF-8 text, or an image's TilePool map
+
+        Payload() = default;
+        Payload(Payload &&) = default;
+        Payload &operator=(Payload &&) = default;
+        Payload(const Payload &) = delete;
+        Payload &operator=(const Payload &) = delete;
+    };
+    using PayloadPtr = std::unique_ptr<Payload>;
+
+    // Everything about an entry but its payload
+    struct Record {
+        Kind kind = Text;
+        quint64 contentKey = 0; // ContentHash fingerprint
+        qint64 timestamp = 0;   // Last copied, ms since epoch
+        quint64 logId = 0;      // HistoryLog record, 0 if kept in memory only
+        qint64 storedBytes = 0; // Size at rest (payload or compressed image)
+        qint64 textBytes = 0;   // Text only; UTF-8 size of the full text
+        quint32 lineCount = 0;  // Text only; 0 if unknown
+        QString label;          // Null until known; see setLabel()
+    };
+
+    int size() const { return int(m_rows.size()); }
+    bool isEmpty() const { return m_rows.empty(); }
+    void reserve(int entries);
+
+    Id idAt(int row) const { return idOfSlot(m_rows[m_rows.size() - 1 - size_t(row)]); }
+    // Row of id, or -1 once the entry is gone
+    int rowOf(Id id) const;
+    bool contains(Id id) const { return slotOf(id) >= 0; }
+    // The newest entry with this fingerprint, or 0
+    Id find(quint64 contentKey) const { return m_idByKey.value(contentKey, 0); }
+
+    // Adds the entry at row 0. An older entry with the same fingerprint
+    // stays findable only through its Id.
+    Id prepend(const Record &record, PayloadPtr payload = nullptr);
+    // Returns the row the entry came from
+    int moveToFront(Id id, qint64 timestamp);
+    // Drops row and every row below it
+    void truncate(int row);
+    void clear();
+
+    Kind kind(Id id) const { return Kind(m_kinds[slot(id)]); }
+    quint64 contentKey(Id id) const { return m_contentKeys[slot(id)]; }
+    // Strictly decreasing from row 0 down
+    quint64 order(Id id) const { return m_orders[slot(id)]; }
+    qint64 timestamp(Id id) const { return m_timestamps[slot(id)]; }
+    quint64 logId(Id id) const { return m_logIds[slot(id)]; }
+    qint64 storedBytes(Id id) const { return m_storedBytes[slot(id)]; }
+    qint64 textBytes(Id id) const { return m_textBytes[slot(id)]; }
+    quint32 lineCount(Id id) const { return m_lineCounts[slot(id)]; }
+    const QString &label(Id id) const { return m_labels[slot(id)]; }
+    // Null if the entry has no payload in memory
+    const Payload *payload(Id id) const { return m_payloads[slot(id)].get(); }
+
+    void setLogId(Id id, quint64 logId) { m_logIds[slot(id)] = logId; }
+    void setStoredBytes(Id id, qint64 bytes) { m_storedBytes[slot(id)] = bytes; }
+    void setTextBytes(Id id, qint64 bytes) { m_textBytes[slot(id)] = bytes; }
+    void setPayload(Id id, PayloadPtr payload) { m_payloads[slot(id)] = std::move(payload); }
+    // Const: labels of log entries are filled in as they are first shown
+    void setLabel(Id id, const QString &label) const { m_labels[slot(id)] = label; }
+
+    // Memory held by the records themselves: the arrays, labels and payload
+    // headers, not the payload data
+    qint64 recordBytes() const;
+
+private:
+    static constexpr Id SlotMask = 0xffffffffu;
+
+    Id idOfSlot(quint32 slot) const { return (Id(m_generations[slot]) << 32) | slot; }
+    // The slot of a live id, or -1
+    qint64 slotOf(Id id) const;
+    // For ids known to be live
+    size_t slot(Id id) const { return size_t(id & SlotMask); }
+    void release(quint32 slot);
+
+    // Columns, by slot
+    std::vector<quint8> m_kinds;
+    std::vector<quint32> m_generations;
+    std::vector<quint64> m_orders;
+    std::vector<quint64> m_contentKeys;
+    std::vector<qint64> m_timestamps;
+    std::vector<quint64> m_logIds;
+    std::vector<qint64> m_storedBytes;
+    std::vector<qint64> m_textBytes;
+    std::vector<quint32> m_lineCounts;
+    mutable std::vector<QString> m_labels;
+    std::vector<PayloadPtr> m_payloads;
+
+    std::vector<quint32> m_freeSlots;
+    // Slots oldest first, so that the newest entry is pushed at the back
+    std::vector<quint32> m_rows;
+    QHash<quint64, Id> m_idByKey;
+    quint64 m_nextOrder = 1;
+};
@@ -0,0 +1,12 @@
+# Links the HistoryStore library (QtCore only; see historystore.h) built by
+# historystore/historystore.pro. Included by linclip.pri. The library is
+# looked for in HISTORYSTORE_LIBDIR, by default the historystore directory
+# next to the including project's build directory.
+
+INCLUDEPATH += $$PWD
+DEPENDPATH += $$PWD
+
+isEmpty(HISTORYSTORE_LIBDIR): HISTORYSTORE_LIBDIR = $$OUT_PWD/../historystore
+
+LIBS += -L$$HISTORYSTORE_LIBDIR -lhistorystore
+PRE_TARGETDEPS += $$HISTORYSTORE_LIBDIR/libhistorystore.a
@@ -0,0 +1,15 @@
+# HistoryStore as a static library that needs neither a display nor
+# QtGui. The application and the benchmarks link it through
+# historystore.pri; tests/ checks it on its own.
+
+TEMPLATE = lib
+QT = core
+
+CONFIG += c++17 staticlib
+
+TARGET = historystore
+
+INCLUDEPATH += $$PWD/..
+
+SOURCES += $$PWD/../historystore.cpp
+HEADERS += $$PWD/../historystore.h
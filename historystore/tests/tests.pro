@@ -0,0 +1,14 @@
+# Headless tests for HistoryStore, linked against the library alone.
+# Run with make check.
+
+QT = core testlib
+
+CONFIG += c++17 console testcase no_testcase_installs
+CONFIG -= app_bundle
+
+TARGET = tst_historystore
+
+SOURCES += tst_historystore.cpp
+
+HISTORYSTORE_LIBDIR = $$OUT_PWD/..
+include(../../historystore.pri)
@@ -0,0 +1,189 @@
+// Headless tests for HistoryStore: row order through prepend, moveToFront
+// and truncate, lookups by fingerprint, and ids going stale once their
+// entry is gone, even when the slot is reused.
+
+#include "historystore.h"
+
+#include <QtTest>
+
+namespace {
+
+HistoryStore::Record textRecord(quint64 contentKey, const QString &label = QString())
+{
+    HistoryStore::Record record;
+    record.contentKey = contentKey;
+    record.timestamp = qint64(contentKey);
+    record.label = label.isNull() ? QString::number(contentKey) : label;
+    record.textBytes = record.storedBytes = record.label.size();
+    record.lineCount = 1;
+    return record;
+}
+
+// Content keys from row 0 down
+QList<quint64> keys(const HistoryStore &store)
+{
+    QList<quint64> keys;
+    for (int row = 0; row < store.size(); ++row)
+        keys.append(store.contentKey(store.idAt(row)));
+    return keys;
+}
+
+} // namespace
+
+class HistoryStoreTest : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void prependPutsNewestFirst();
+    void prependKeepsPayload();
+    void moveToFront();
+    void truncate();
+    void clear();
+    void staleIdsThroughGenerations();
+};
+
+void HistoryStoreTest::prependPutsNewestFirst()
+{
+    HistoryStore store;
+    QVERIFY(store.isEmpty());
+    const HistoryStore::Id first = store.prepend(textRecord(1, "one"));
+    const HistoryStore::Id second = store.prepend(textRecord(2, "two"));
+    const HistoryStore::Id third = store.prepend(textRecord(3, "three"));
+
+    QCOMPARE(store.size(), 3);
+    QCOMPARE(keys(store), QList<quint64>({ 3, 2, 1 }));
+    QCOMPARE(store.rowOf(third), 0);
+    QCOMPARE(store.rowOf(second), 1);
+    QCOMPARE(store.rowOf(first), 2);
+    QVERIFY(store.order(third) > store.order(second));
+    QVERIFY(store.order(second) > store.order(first));
+
+    QCOMPARE(store.find(2), second);
+    QCOMPARE(store.find(4), HistoryStore::Id(0));
+    QCOMPARE(store.kind(second), HistoryStore::Text);
+    QCOMPARE(store.label(second), QStringLiteral("two"));
+    QCOMPARE(store.timestamp(second), qint64(2));
+    QVERIFY(!store.payload(second));
+}
+
+void HistoryStoreTest::prependKeepsPayload()
+{
+    HistoryStore store;
+    auto payload = std::make_unique<HistoryStore::Payload>();
+    payload->text = QStringLiteral("full text");
+    const HistoryStore::Id id = store.prepend(textRecord(1), std::move(payload));
+
+    QVERIFY(store.payload(id));
+    QCOMPARE(store.payload(id)->text, QStringLiteral("full text"));
+    store.setPayload(id, nullptr);
+    QVERIFY(!store.payload(id));
+}
+
+void HistoryStoreTest::moveToFront()
+{
+    HistoryStore store;
+    const HistoryStore::Id first = store.prepend(textRecord(1));
+    store.prepend(textRecord(2));
+    const HistoryStore::Id third = store.prepend(textRecord(3));
+
+    QCOMPARE(store.moveToFront(first, 100), 2);
+    QCOMPARE(keys(store), QList<quint64>({ 1, 3, 2 }));
+    QCOMPARE(store.rowOf(first), 0);
+    QCOMPARE(store.timestamp(first), qint64(100));
+
+    // Already at the front: only the timestamp changes
+    QCOMPARE(store.moveToFront(first, 200), 0);
+    QCOMPARE(keys(store), QList<quint64>({ 1, 3, 2 }));
+    QCOMPARE(store.timestamp(first), qint64(200));
+
+    QCOMPARE(store.moveToFront(third, 300), 1);
+    QCOMPARE(keys(store), QList<quint64>({ 3, 1, 2 }));
+    for (int row = 1; row < store.size(); ++row)
+        QVERIFY(store.order(store.idAt(row - 1)) > store.order(store.idAt(row)));
+}
+
+void HistoryStoreTest::truncate()
+{
+    HistoryStore store;
+    QList<HistoryStore::Id> ids;
+    for (quint64 key = 1; key <= 5; ++key)
+        ids.append(store.prepend(textRecord(key)));
+
+    // Out of range: nothing happens
+    store.truncate(-1);
+    store.truncate(5);
+    QCOMPARE(store.size(), 5);
+
+    store.truncate(3);
+    QCOMPARE(keys(store), QList<quint64>({ 5, 4, 3 }));
+    QVERIFY(!store.contains(ids[0]));
+    QVERIFY(!store.contains(ids[1]));
+    QCOMPARE(store.rowOf(ids[0]), -1);
+    QCOMPARE(store.find(1), HistoryStore::Id(0));
+    QCOMPARE(store.find(2), HistoryStore::Id(0));
+    QCOMPARE(store.find(3), ids[2]);
+
+    store.truncate(0);
+    QVERIFY(store.isEmpty());
+    QCOMPARE(store.find(5), HistoryStore::Id(0));
+}
+
+void HistoryStoreTest::clear()
+{
+    HistoryStore store;
+    const HistoryStore::Id first = store.prepend(textRecord(1));
+    const HistoryStore::Id second = store.prepend(textRecord(2));
+
+    store.clear();
+    QVERIFY(store.isEmpty());
+    QVERIFY(!store.contains(first));
+    QVERIFY(!store.contains(second));
+    QCOMPARE(store.find(1), HistoryStore::Id(0));
+
+    // Usable again afterwards
+    const HistoryStore::Id again = store.prepend(textRecord(1));
+    QCOMPARE(store.size(), 1);
+    QCOMPARE(store.find(1), again);
+    QCOMPARE(store.rowOf(again), 0);
+}
+
+void HistoryStoreTest::staleIdsThroughGenerations()
+{
+    HistoryStore store;
+    const HistoryStore::Id old = store.prepend(textRecord(1));
+    store.truncate(0);
+
+    // The freed slot is reused, under a new generation
+    const HistoryStore::Id reused = store.prepend(textRecord(2));
+    QCOMPARE(reused & 0xffffffffu, old & 0xffffffffu);
+    QVERIFY(reused != old);
+    QVERIFY(!store.contains(old));
+    QVERIFY(store.contains(reused));
+    QCOMPARE(store.rowOf(old), -1);
+    QCOMPARE(store.moveToFront(old, 10), -1);
+    QCOMPARE(store.timestamp(reused), qint64(2));
+
+    // And again through clear(): every earlier id stays stale
+    store.clear();
+    const HistoryStore::Id third = store.prepend(textRecord(3));
+    QCOMPARE(third & 0xffffffffu, old & 0xffffffffu);
+    QVERIFY(third != old && third != reused);
+    QVERIFY(!store.contains(old));
+    QVERIFY(!store.contains(reused));
+    QVERIFY(store.contains(third));
+
+    // An older entry with the same fingerprint is only reachable by its id,
+    // and removing it leaves the newer one findable
+    const HistoryStore::Id older = store.prepend(textRecord(4));
+    const HistoryStore::Id newer = store.prepend(textRecord(4));
+    QCOMPARE(store.find(4), newer);
+    store.truncate(2); // Drops third only
+    QVERIFY(store.contains(older));
+    store.truncate(1);
+    QVERIFY(!store.contains(older));
+    QCOMPARE(store.find(4), newer);
+}
+
+QTEST_APPLESS_MAIN(HistoryStoreTest)
+#include "tst_historystore.moc"
@@ -1,17 +1,33 @@
 #pragma once
 
 #include <X11/Xlib.h>
+#include <vector>
+
+struct HotkeyBinding;
 
 // This class holds all X11-specific details.
 // It is hidden from the rest of the project by only being included in the .cpp.
 class HotkeyPrivate {
 public:
+    // A grabbed key combination and the index of the binding it belongs to
+    struct Grab {
+        int keycode = 0;
+        unsigned int modifiers = 0;
+        int binding = -1;
+    };
+
+    HotkeyPrivate();
     ~HotkeyPrivate();
 
-    bool registerHotkey();
-    void unregisterHotkey();
+    bool registerHotkeys(const HotkeyBinding *bindings, int count);
+    void unregisterHotkeys();
+    int bindingForEvent(const XKeyEvent &event) const;
 
     Display *display = nullptr;
     Window rootWindow = 0;
-    int keycode = 0;
+    unsigned int numLockMask = 0;
+    std::vector<Grab> grabs;
+
+    // eventfd used by stop() to wake the poll() in run()
+    int wakeFd = -1;
 };
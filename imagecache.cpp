@@ -0,0 +1,53 @@
+#include "imagecache.h"
+
+ImageCache::ImageCache(qsizetype budgetBytes)
+    : m_images(budgetBytes)
+{
+}
+
+QImage ImageCache::find(quint64 key) const
+{
+    QMutexLocker locker(&m_mutex);
+    const QImage *image = m_images.object(key);
+    return image ? *image : QImage();
+}
+
+void ImageCache::insert(quint64 key, const QImage &image)
+{
+    if (image.isNull())
+        return;
+
+    // QCache refuses (and deletes) objects costing more than the budget
+    QMutexLocker locker(&m_mutex);
+    m_images.insert(key, new QImage(image), qMax<qsizetype>(1, image.sizeInBytes()));
+}
+
+void ImageCache::remove(quint64 key)
+{
+    QMutexLocker locker(&m_mutex);
+    m_images.remove(key);
+}
+
+void ImageCache::clear()
+{
+    QMutexLocker locker(&m_mutex);
+    m_images.clear();
+}
+
+qsizetype ImageCache::budget() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_images.maxCost();
+}
+
+void ImageCache::setBudget(qsizetype budgetBytes)
+{
+    QMutexLocker locker(&m_mutex);
+    m_images.setMaxCost(budgetBytes);
+}
+
+qsizetype ImageCache::decodedBytes() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_images.totalCost();
+}
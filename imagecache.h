@@ -0,0 +1,27 @@
+#pragma once
+
+#include <QCache>
+#include <QImage>
+#include <QMutex>
+
+// Thread-safe LRU of decoded images keyed by content fingerprint. The
+// budget is in bytes of pixel data, so memory stays bounded no matter how
+// many (or how large) the image clips in the history are.
+class ImageCache
+{
+public:
+    explicit ImageCache(qsizetype budgetBytes);
+
+    QImage find(quint64 key) const;
+    void insert(quint64 key, const QImage &image);
+    void remove(quint64 key);
+    void clear();
+
+    qsizetype budget() const;
+    void setBudget(qsizetype budgetBytes);
+    qsizetype decodedBytes() const;
+
+private:
+    mutable QMutex m_mutex;
+    mutable QCache<quint64, QImage> m_images; // object() updates the LRU order
+};
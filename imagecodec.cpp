@@ -0,0 +1,241 @@
+#include "imagecodec.h"
+
+#include <cstring>
+
+namespace {
+
+// Payload: Header, then a standard QOI stream (4 channels). The four
+// channels are the pixel's bytes in memory order, whatever the format,
+// which keeps every 32-bit QImage format lossless without conversion.
+struct Header {
+    quint32 magic;
+    qint32 format;
+};
+
+constexpr quint32 Magic = 0x31494f51; // "QOI1"
+constexpr uchar OpIndex = 0x00;
+constexpr uchar OpDiff = 0x40;
+constexpr uchar OpLuma = 0x80;
+constexpr uchar OpRun = 0xc0;
+constexpr uchar OpRgb = 0xfe;
+constexpr uchar OpRgba = 0xff;
+constexpr uchar Mask2 = 0xc0;
+constexpr int QoiHeaderSize = 14;
+constexpr uchar Padding[8] = { 0, 0, 0, 0, 0, 0, 0, 1 };
+
+struct Pixel {
+    uchar r, g, b, a;
+    bool operator==(const Pixel &o) const { return r == o.r && g == o.g && b == o.b && a == o.a; }
+};
+
+inline int hashPixel(const Pixel &p)
+{
+    return (p.r * 3 + p.g * 5 + p.b * 7 + p.a * 11) % 64;
+}
+
+inline void write32be(uchar *p, quint32 v)
+{
+    p[0] = uchar(v >> 24);
+    p[1] = uchar(v >> 16);
+    p[2] = uchar(v >> 8);
+    p[3] = uchar(v);
+}
+
+inline quint32 read32be(const uchar *p)
+{
+    return quint32(p[0]) << 24 | quint32(p[1]) << 16 | quint32(p[2]) << 8 | quint32(p[3]);
+}
+
+bool is32Bit(QImage::Format format)
+{
+    switch (format) {
+    case QImage::Format_RGB32:
+    case QImage::Format_ARGB32:
+    case QImage::Format_ARGB32_Premultiplied:
+    case QImage::Format_RGBX8888:
+    case QImage::Format_RGBA8888:
+    case QImage::Format_RGBA8888_Premultiplied:
+        return true;
+    default:
+        return false;
+    }
+}
+
+} // namespace
+
+namespace ImageCodec {
+
+QImage storable(const QImage &image)
+{
+    if (image.isNull() || is32Bit(image.format()))
+        return image;
+    return image.convertToFormat(image.hasAlphaChannel() ? QImage::Format_ARGB32 : QImage::Format_RGB32);
+}
+
+QByteArray compress(const QImage &source)
+{
+    if (source.isNull())
+        return QByteArray();
+
+    const QImage image = storable(source);
+    const int width = image.width();
+    const int height = image.height();
+
+    // Worst case is one OpRgba (5 bytes) per pixel
+    const qsizetype maxSize = qsizetype(sizeof(Header)) + QoiHeaderSize
+        + qsizetype(width) * height * 5 + qsizetype(sizeof(Padding));
+    QByteArray out(maxSize, Qt::Uninitialized);
+    uchar *bytes = reinterpret_cast<uchar *>(out.data());
+
+    const Header header = { Magic, qint32(image.format()) };
+    std::memcpy(bytes, &header, sizeof(header));
+    uchar *p = bytes + sizeof(header);
+    std::memcpy(p, "qoif", 4);
+    write32be(p + 4, quint32(width));
+    write32be(p + 8, quint32(height));
+    p[12] = 4; // channels
+    p[13] = 0; // colorspace
+    p += QoiHeaderSize;
+
+    Pixel index[64] = {};
+    Pixel prev = { 0, 0, 0, 255 };
+    int run = 0;
+    for (int y = 0; y < height; ++y) {
+        const uchar *row = image.constScanLine(y);
+        const bool lastRow = y == height - 1;
+        for (int x = 0; x < width; ++x) {
+            Pixel px;
+            std::memcpy(&px, row + x * 4, 4);
+
+            if (px == prev) {
+                ++run;
+                if (run == 62 || (lastRow && x == width - 1)) {
+                    *p++ = OpRun | uchar(run - 1);
+                    run = 0;
+                }
+                continue;
+            }
+
+            if (run > 0) {
+                *p++ = OpRun | uchar(run - 1);
+                run = 0;
+            }
+
+            const int h = hashPixel(px);
+            if (index[h] == px) {
+                *p++ = OpIndex | uchar(h);
+            } else {
+                index[h] = px;
+                if (px.a == prev.a) {
+                    const signed char vr = static_cast<signed char>(px.r - prev.r);
+                    const signed char vg = static_cast<signed char>(px.g - prev.g);
+                    const signed char vb = static_cast<signed char>(px.b - prev.b);
+                    const signed char vgr = static_cast<signed char>(vr - vg);
+                    const signed char vgb = static_cast<signed char>(vb - vg);
+                    if (vr > -3 && vr < 2 && vg > -3 && vg < 2 && vb > -3 && vb < 2) {
+                        *p++ = OpDiff | uchar((vr + 2) << 4 | (vg + 2) << 2 | (vb + 2));
+                    } else if (vgr > -9 && vgr < 8 && vg > -33 && vg < 32 && vgb > -9 && vgb < 8) {
+                        *p++ = OpLuma | uchar(vg + 32);
+                        *p++ = uchar((vgr + 8) << 4 | (vgb + 8));
+                    } else {
+                        *p++ = OpRgb;
+                        *p++ = px.r;
+                        *p++ = px.g;
+                        *p++ = px.b;
+                    }
+                } else {
+                    *p++ = OpRgba;
+                    *p++ = px.r;
+                    *p++ = px.g;
+                    *p++ = px.b;
+                    *p++ = px.a;
+                }
+            }
+            prev = px;
+        }
+    }
+
+    std::memcpy(p, Padding, sizeof(Padding));
+    p += sizeof(Padding);
+    out.resize(p - bytes);
+    out.squeeze();
+    return out;
+}
+
+QImage decompress(const char *data, qsizetype size)
+{
+    const qsizetype headerSize = qsizetype(sizeof(Header)) + QoiHeaderSize;
+    if (!data || size < headerSize + qsizetype(sizeof(Padding)))
+        return QImage();
+
+    Header header;
+    std::memcpy(&header, data, sizeof(header));
+    const uchar *qoi = reinterpret_cast<const uchar *>(data) + sizeof(header);
+    if (header.magic != Magic || std::memcmp(qoi, "qoif", 4) != 0 || qoi[12] != 4
+        || !is32Bit(QImage::Format(header.format)))
+        return QImage();
+
+    const quint32 width = read32be(qoi + 4);
+    const quint32 height = read32be(qoi + 8);
+    if (width == 0 || height == 0 || width > 65535 || height > 65535)
+        return QImage();
+
+    QImage image(int(width), int(height), QImage::Format(header.format));
+    if (image.isNull())
+        return QImage();
+
+    const uchar *p = qoi + QoiHeaderSize;
+    const uchar *const chunksEnd = reinterpret_cast<const uchar *>(data) + size - sizeof(Padding);
+    Pixel index[64] = {};
+    Pixel px = { 0, 0, 0, 255 };
+    int run = 0;
+    for (int y = 0; y < int(height); ++y) {
+        uchar *row = image.scanLine(y);
+        for (int x = 0; x < int(width); ++x) {
+            if (run > 0) {
+                --run;
+            } else if (p < chunksEnd) {
+                const uchar b1 = *p++;
+                if (b1 == OpRgb) {
+                    if (chunksEnd - p < 3)
+                        return QImage();
+                    px.r = p[0];
+                    px.g = p[1];
+                    px.b = p[2];
+                    p += 3;
+                } else if (b1 == OpRgba) {
+                    if (chunksEnd - p < 4)
+                        return QImage();
+                    px.r = p[0];
+                    px.g = p[1];
+                    px.b = p[2];
+                    px.a = p[3];
+                    p += 4;
+                } else if ((b1 & Mask2) == OpIndex) {
+                    px = index[b1];
+                } else if ((b1 & Mask2) == OpDiff) {
+                    px.r += ((b1 >> 4) & 0x03) - 2;
+                    px.g += ((b1 >> 2) & 0x03) - 2;
+                    px.b += (b1 & 0x03) - 2;
+                } else if ((b1 & Mask2) == OpLuma) {
+                    if (p >= chunksEnd)
+                        return QImage();
+                    const uchar b2 = *p++;
+                    const int vg = (b1 & 0x3f) - 32;
+                    px.r += vg - 8 + ((b2 >> 4) & 0x0f);
+                    px.g += vg;
+                    px.b += vg - 8 + (b2 & 0x0f);
+                } else {
+                    run = b1 & 0x3f;
+                }
+                index[hashPixel(px)] = px;
+            } else {
+                return QImage(); // Truncated stream
+            }
+            std::memcpy(row + x * 4, &px, 4);
+        }
+    }
+    return image;
+}
+
+} // namespace ImageCodec
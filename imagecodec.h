@@ -0,0 +1,18 @@
+#pragma once
+
+#include <QByteArray>
+#include <QImage>
+
+// Lossless compression for image clips at rest. Images are encoded as QOI
+// (https://qoiformat.org): one pass, no entropy coder, typically 3-5x on
+// screenshots at several hundred MB/s, so it is cheap enough to run right
+// after every capture. The QImage format is kept so decoding is exact.
+namespace ImageCodec {
+
+// The image in a 32-bit format, which compress() keeps as it is
+QImage storable(const QImage &image);
+QByteArray compress(const QImage &image);
+QImage decompress(const char *data, qsizetype size);
+inline QImage decompress(const QByteArray &data) { return decompress(data.constData(), data.size()); }
+
+} // namespace ImageCodec
@@ -0,0 +1,57 @@
+# Everything but main.cpp, shared by the application and the benchmarks
+
+INCLUDEPATH += $$PWD
+DEPENDPATH += $$PWD
+
+include(historystore.pri)
+
+SOURCES += \
+    $$PWD/capturedcontent.cpp \
+    $$PWD/clipboardcapture.cpp \
+    $$PWD/contenthash.cpp \
+    $$PWD/controlprotocol.cpp \
+    $$PWD/controlserver.cpp \
+    $$PWD/encodedcache.cpp \
+    $$PWD/entrymimedata.cpp \
+    $$PWD/mainwindow.cpp \
+    $$PWD/globalhotkeymanager.cpp \
+    $$PWD/historydelegate.cpp \
+    $$PWD/historylog.cpp \
+    $$PWD/historymodel.cpp \
+    $$PWD/imagecache.cpp \
+    $$PWD/imagecodec.cpp \
+    $$PWD/originalformats.cpp \
+    $$PWD/searchindex.cpp \
+    $$PWD/searchresultsmodel.cpp \
+    $$PWD/selectionwatcher.cpp \
+    $$PWD/thumbnailcache.cpp \
+    $$PWD/tilepool.cpp \
+    $$PWD/trace.cpp
+
+HEADERS += \
+    $$PWD/capturedcontent.h \
+    $$PWD/clipboardcapture.h \
+    $$PWD/contenthash.h \
+    $$PWD/controlprotocol.h \
+    $$PWD/controlserver.h \
+    $$PWD/encodedcache.h \
+    $$PWD/entrymimedata.h \
+    $$PWD/hotkeyprivate.h \
+    $$PWD/mainwindow.h \
+    $$PWD/globalhotkeymanager.h \
+    $$PWD/historydelegate.h \
+    $$PWD/historylog.h \
+    $$PWD/historymodel.h \
+    $$PWD/imagecache.h \
+    $$PWD/imagecodec.h \
+    $$PWD/originalformats.h \
+    $$PWD/searchindex.h \
+    $$PWD/searchresultsmodel.h \
+    $$PWD/selectionprivate.h \
+    $$PWD/selectionwatcher.h \
+    $$PWD/thumbnailcache.h \
+    $$PWD/tilepool.h \
+    $$PWD/trace.h
+
+# Link X11 libraries
+LIBS += -lX11 -lxcb -lXfixes
@@ -1,14 +1,27 @@
 #include "mainwindow.h"
+#include "trace.h"
 #include <QApplication>
 
 int main(int argc, char *argv[])
 {
     QApplication a(argc, argv);
+    // Used by QSettings: ~/.config/LinClip/LinClip.conf
+    a.setOrganizationName("LinClip");
+    a.setApplicationName("LinClip");
 
     // By default, the app will keep running even if the window is closed,
     // because the system tray icon will still exist.
     a.setQuitOnLastWindowClosed(false);
 
+    // LINCLIP_TRACE=file.json saves the latency trace on exit, for
+    // chrome://tracing or Perfetto
+    const QString tracePath = qEnvironmentVariable("LINCLIP_TRACE");
+    if (!tracePath.isEmpty()) {
+        QObject::connect(&a, &QApplication::aboutToQuit, [tracePath]() {
+            Trace::writeChromeTrace(tracePath);
+        });
+    }
+
     MainWindow w;
 
     // UPDATED: We no longer show the window on startup.
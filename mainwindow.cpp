@@ -1,22 +1,38 @@
 #include "mainwindow.h"
+#include "clipboardcapture.h"
+#include "controlserver.h"
+#include "encodedcache.h"
+#include "entrymimedata.h"
 #include "globalhotkeymanager.h"
+#include "historydelegate.h"
+#include "historymodel.h"
+#include "searchindex.h"
+#include "searchresultsmodel.h"
+#include "selectionwatcher.h"
+#include "trace.h"
 
 // Qt headers
 #include <QApplication>
 #include <QClipboard>
 #include <QGuiApplication>
-#include <QListWidget>
+#include <QItemSelectionModel>
+#include <QKeyEvent>
+#include <QLineEdit>
+#include <QListView>
 #include <QMenu>
+#include <QMessageBox>
+#include <QSettings>
 #include <QShortcut>
+#include <QStandardPaths>
 #include <QStatusBar>
 #include <QSystemTrayIcon>
 #include <QThread>
+#include <QTimer>
 #include <QCursor>
 #include <QVBoxLayout>
 #include <QImage>
+#include <QLocale>
 #include <QVariant>
-#include <QMimeData>
-#include <QUrl>        // ADDED: To handle file paths
 
 MainWindow::MainWindow(QWidget *parent)
     : QMainWindow(parent)
@@ -28,31 +44,65 @@ MainWindow::MainWindow(QWidget *parent)
     QWidget *centralContainer = new QWidget(this);
     QVBoxLayout *mainLayout = new QVBoxLayout(centralContainer);
     mainLayout->setContentsMargins(5, 5, 5, 5);
-    listWidget = new QListWidget(this);
-    mainLayout->addWidget(listWidget);
+    searchEdit = new QLineEdit(this);
+    searchEdit->setPlaceholderText("Search");
+    searchEdit->setClearButtonEnabled(true);
+    mainLayout->addWidget(searchEdit);
+    listView = new QListView(this);
+    mainLayout->addWidget(listView);
     setCentralWidget(centralContainer);
 
-    // --- Styling (no change) ---
-    listWidget->setStyleSheet(
-        "QListWidget::item {"
-        "  padding: 6px 8px;"
-        "}"
-        "QListWidget::item:selected {"
-        "  background-color: #3377dd;"
-        "  color: white;"
-        "}"
-        );
+    // --- History model: only the visible rows are ever laid out or painted ---
+    historyModel = new HistoryModel(this);
+    encodedCache = std::make_shared<EncodedCache>();
+    QSettings settings;
+    historyModel->setMaxEntries(settings.value("History/maxEntries", HistoryModel::DefaultMaxEntries).toInt());
+    historyModel->setImageCacheBudget(settings.value("History/imageCacheMB", HistoryModel::DefaultImageCacheBytes / (1024 * 1024)).toLongLong() * 1024 * 1024);
+    if (settings.value("History/persistent", true).toBool()) {
+        historyModel->openStorage(QStandardPaths::writableLocation(QStandardPaths::AppDataLocation));
+    }
+    listView->setModel(historyModel);
+    listView->setItemDelegate(new HistoryDelegate(listView));
+    listView->setUniformItemSizes(true);
+    listView->setLayoutMode(QListView::Batched);
+    listView->setIconSize(QSize(HistoryDelegate::IconSize, HistoryDelegate::IconSize));
+
+    // --- Search: queries run off the GUI thread, newer ones cancel older ones ---
+    searchResults = new SearchResultsModel(historyModel, this);
+    connect(searchEdit, &QLineEdit::textChanged, this, &MainWindow::onSearchTextChanged);
+    connect(historyModel->searchIndex(), &SearchIndex::resultsReady, this, &MainWindow::onSearchResults);
+    // Keep the results current while entries come and go
+    auto refreshSearch = [this]() { onSearchTextChanged(searchEdit->text()); };
+    connect(historyModel, &HistoryModel::rowsInserted, this, refreshSearch);
+    connect(historyModel, &HistoryModel::rowsRemoved, this, refreshSearch);
+    connect(historyModel, &HistoryModel::rowsMoved, this, refreshSearch);
+    connect(historyModel, &HistoryModel::modelReset, this, refreshSearch);
+    // Arrow keys move through the list while typing
+    searchEdit->installEventFilter(this);
+    // Times the first paint after the popup is shown
+    listView->viewport()->installEventFilter(this);
+    connect(searchEdit, &QLineEdit::returnPressed, [this]() {
+        if (listView->currentIndex().isValid()) {
+            onItemActivated(listView->currentIndex());
+        }
+    });
 
-    connect(listWidget, &QListWidget::itemDoubleClicked, this, &MainWindow::onItemActivated);
+    connect(listView, &QListView::doubleClicked, this, &MainWindow::onItemActivated);
 
+    // --- Capture: payloads are fetched, size-checked and decoded off the GUI thread ---
     clipboard = QGuiApplication::clipboard();
-    connect(clipboard, &QClipboard::dataChanged, this, &MainWindow::onClipboardChanged);
+    capture = new ClipboardCapture(clipboard, this);
+    capture->setDebounceInterval(settings.value("Capture/debounceMs", ClipboardCapture::DebounceMs).toInt());
+    capture->setSizeLimit(ClipboardCapture::Text, settings.value("Capture/textLimitMB", ClipboardCapture::DefaultTextLimit / (1024 * 1024)).toLongLong() * 1024 * 1024);
+    capture->setSizeLimit(ClipboardCapture::Image, settings.value("Capture/imageLimitMB", ClipboardCapture::DefaultImageLimit / (1024 * 1024)).toLongLong() * 1024 * 1024);
+    capture->setSizeLimit(ClipboardCapture::File, settings.value("Capture/fileLimitMB", ClipboardCapture::DefaultFileLimit / (1024 * 1024)).toLongLong() * 1024 * 1024);
+    connect(capture, &ClipboardCapture::captured, this, &MainWindow::onClipboardCaptured);
 
     // --- Shortcuts (no change) ---
     QShortcut *enterShortcut = new QShortcut(QKeySequence(Qt::Key_Return), this);
     connect(enterShortcut, &QShortcut::activated, [this]() {
-        if (listWidget->currentItem()) {
-            onItemActivated(listWidget->currentItem());
+        if (listView->currentIndex().isValid()) {
+            onItemActivated(listView->currentIndex());
         }
     });
     QShortcut *deleteShortcut = new QShortcut(QKeySequence(Qt::Key_Delete), this);
@@ -60,86 +110,239 @@ MainWindow::MainWindow(QWidget *parent)
     QShortcut *quitShortcut = new QShortcut(QKeySequence(tr("Ctrl+Q", "Quit")), this);
     connect(quitShortcut, &QShortcut::activated, qApp, &QApplication::quit);
 
-    createTrayIcon();
+    // --- X threads: the first hotkey press and copy need them right away ---
+    startHotkeys();
+    if (settings.value("Capture/native", true).toBool())
+        startSelectionWatcher();
 
-    // --- Hotkey Thread Setup (no change) ---
+    // --- Deferred startup: the rest, one step per tick of a timer, so that
+    // input arriving meanwhile (a first hotkey press) is handled in between ---
+    if (settings.value("Startup/deferred", true).toBool()) {
+        QTimer *startupTimer = new QTimer(this);
+        startupTimer->setInterval(StartupStepMs);
+        connect(startupTimer, &QTimer::timeout, this, [this, startupTimer]() {
+            if (!runStartupStep()) {
+                startupTimer->stop();
+                startupTimer->deleteLater();
+            }
+        });
+        startupTimer->start();
+    } else {
+        while (runStartupStep()) {
+        }
+    }
+}
+
+void MainWindow::startHotkeys()
+{
     hotkeyThread = new QThread();
-    hotkeyManager = new GlobalHotkeyManager();
+    hotkeyThread->setObjectName("Hotkeys");
+    hotkeyManager = new GlobalHotkeyManager(GlobalHotkeyManager::bindingsFromSettings());
     hotkeyManager->moveToThread(hotkeyThread);
     connect(hotkeyThread, &QThread::started, hotkeyManager, &GlobalHotkeyManager::run);
-    connect(hotkeyManager, &GlobalHotkeyManager::hotkeyPressed, this, &MainWindow::toggleVisibility);
-    connect(qApp, &QApplication::aboutToQuit, hotkeyManager, &GlobalHotkeyManager::stop);
+    connect(hotkeyManager, &GlobalHotkeyManager::hotkeyPressed, this, &MainWindow::onHotkeyPressed);
+    // Direct: run() blocks in poll(), so a queued stop() would never be delivered
+    connect(qApp, &QApplication::aboutToQuit, hotkeyManager, &GlobalHotkeyManager::stop, Qt::DirectConnection);
     connect(hotkeyManager, &GlobalHotkeyManager::finished, hotkeyThread, &QThread::quit);
     connect(hotkeyThread, &QThread::finished, hotkeyThread, &QThread::deleteLater);
     connect(hotkeyThread, &QThread::finished, hotkeyManager, &GlobalHotkeyManager::deleteLater);
     hotkeyThread->start();
 }
 
-MainWindow::~MainWindow()
+// XFixes and INCR on their own thread, wired like the hotkeys
+void MainWindow::startSelectionWatcher()
 {
-    // Cleanup is handled by signal connections
+    QSettings settings;
+    SelectionWatcher::Selections selections = SelectionWatcher::Clipboard;
+    if (settings.value("Capture/primary", false).toBool())
+        selections |= SelectionWatcher::Primary;
+    selectionThread = new QThread();
+    selectionThread->setObjectName("Selections");
+    selectionWatcher = new SelectionWatcher(selections, ClipboardCapture::imageFormats());
+    selectionWatcher->setSizeLimits(capture->sizeLimit(ClipboardCapture::Text),
+                                    capture->sizeLimit(ClipboardCapture::Image));
+    selectionWatcher->moveToThread(selectionThread);
+    connect(selectionThread, &QThread::started, selectionWatcher, &SelectionWatcher::run);
+    connect(selectionWatcher, &SelectionWatcher::watching, this, [this]() {
+        selectionsWatched = true;
+        capture->setWatchingClipboard(false);
+    });
+    connect(selectionWatcher, &SelectionWatcher::selectionCaptured, capture, &ClipboardCapture::captureSelection);
+    connect(qApp, &QApplication::aboutToQuit, selectionWatcher, &SelectionWatcher::stop, Qt::DirectConnection);
+    // Also when the watcher gives up: QClipboard takes over again
+    connect(selectionWatcher, &SelectionWatcher::finished, this, [this]() {
+        selectionsWatched = false;
+        selectionWatcher = nullptr; // Deleted with its thread
+        capture->setWatchingClipboard(true);
+    });
+    connect(selectionWatcher, &SelectionWatcher::finished, selectionThread, &QThread::quit);
+    connect(selectionThread, &QThread::finished, selectionThread, &QThread::deleteLater);
+    connect(selectionThread, &QThread::finished, selectionWatcher, &SelectionWatcher::deleteLater);
+    selectionThread->start();
 }
 
-// ---------------------
-// Slots
-// ---------------------
-void MainWindow::onItemActivated(QListWidgetItem *item)
+// Returns whether steps are left
+bool MainWindow::runStartupStep()
 {
-    if (!item) return;
+    switch (startupStep++) {
+    case 0:
+        // --- Control socket: linclip-ctl and scripts ---
+        if (QSettings().value("Control/socket", true).toBool()) {
+            controlServer = new ControlServer(historyModel, this);
+            if (controlServer->listen())
+                connect(controlServer, &ControlServer::activateRequested, this, &MainWindow::activateRow);
+        }
+        return true;
+    case 1:
+        createTrayIcon();
+        return true;
+    case 2:
+        warmPopup();
+        return true;
+    default:
+        startupFinished = true;
+        Trace::record(Trace::StartupReady, Trace::processStart(), Trace::now());
+        emit ready();
+        return false;
+    }
+}
 
-    QVariant data = item->data(Qt::UserRole);
+// Styles, polishes and lays out the hidden popup and creates its native
+// window, so that showing it only maps and paints it
+void MainWindow::warmPopup()
+{
+    const qint64 started = Trace::now();
+    listView->setStyleSheet(
+        "QListView::item {"
+        "  padding: 6px 8px;"
+        "}"
+        "QListView::item:selected {"
+        "  background-color: #3377dd;"
+        "  color: white;"
+        "}"
+        );
+    ensurePolished();
+    centralWidget()->layout()->activate();
+    listView->doItemsLayout();
+    winId();
+    // One offscreen paint loads the fonts, glyphs and first thumbnails
+    grab();
+    Trace::record(Trace::PopupWarm, started, Trace::now());
+}
 
-    if (data.canConvert<QImage>()) {
-        clipboard->setImage(data.value<QImage>());
-    } else if (data.canConvert<QString>()) {
-        clipboard->setText(data.value<QString>());
+MainWindow::~MainWindow()
+{
+    // The X threads go with the window, not only at aboutToQuit: a window
+    // may be destroyed while the application carries on (the benchmarks
+    // create several), and stale threads would compete for the server
+    if (selectionWatcher)
+        selectionWatcher->stop();
+    if (hotkeyManager)
+        hotkeyManager->stop();
+    for (QThread *thread : { selectionThread.data(), hotkeyThread.data() }) {
+        if (thread) {
+            thread->quit();
+            thread->wait();
+        }
     }
-    hide();
+    // Its workers read images from the model, which as the older child
+    // would be deleted first
+    delete controlServer;
 }
 
-void MainWindow::onClipboardChanged()
+bool MainWindow::eventFilter(QObject *watched, QEvent *event)
 {
-    const QMimeData *mimeData = clipboard->mimeData();
-    QVariant newContent;
-
-    // --- MODIFIED: More robust content checking ---
-    // 1. Prioritize raw image data (e.g., from screenshots, "Copy Image")
-    if (mimeData->hasImage()) {
-        newContent = clipboard->image();
+    if (watched == listView->viewport() && event->type() == QEvent::Paint && paintPendingSince != 0) {
+        const qint64 shownAt = paintPendingSince;
+        paintPendingSince = 0;
+        // Deliver it now, so that the time includes the painting itself
+        QCoreApplication::sendEvent(watched, event);
+        const qint64 paintedAt = Trace::now();
+        Trace::record(Trace::PopupPaint, shownAt, paintedAt);
+        if (hotkeyReceivedAt != 0) {
+            Trace::record(Trace::HotkeyToPaint, hotkeyReceivedAt, paintedAt);
+            hotkeyReceivedAt = 0;
+        }
+        return true;
     }
-    // 2. Check for image file paths (e.g., from "Copy" in a file manager)
-    else if (mimeData->hasUrls()) {
-        QList<QUrl> urls = mimeData->urls();
-        if (!urls.isEmpty() && urls.first().isLocalFile()) {
-            // Try to load the file as an image
-            QImage image(urls.first().toLocalFile());
-            if (!image.isNull()) {
-                newContent = image;
-            }
+    if (watched == searchEdit && event->type() == QEvent::KeyPress) {
+        switch (static_cast<QKeyEvent *>(event)->key()) {
+        case Qt::Key_Up:
+        case Qt::Key_Down:
+        case Qt::Key_PageUp:
+        case Qt::Key_PageDown:
+            QCoreApplication::sendEvent(listView, event);
+            return true;
+        default:
+            break;
         }
     }
+    return QMainWindow::eventFilter(watched, event);
+}
 
-    // 3. If we still haven't found an image, check for plain text.
-    // This prevents grabbing the file path as text if the URL was an image.
-    if (!newContent.isValid() && mimeData->hasText()) {
-        newContent = clipboard->text();
-    }
+void MainWindow::hideEvent(QHideEvent *event)
+{
+    QMainWindow::hideEvent(event);
+    hotkeyReceivedAt = 0;
+    paintPendingSince = 0;
+    // Back to the full history for the next show, while nobody waits for it
+    searchEdit->clear();
+    listView->scrollToTop();
+}
 
-    // If after all checks, we still have no valid content, exit.
-    if (!newContent.isValid()) return;
+// ---------------------
+// Slots
+// ---------------------
+void MainWindow::onItemActivated(const QModelIndex &index)
+{
+    if (!index.isValid()) return;
 
-    // Prevent adding empty text or a null image
-    if (newContent.canConvert<QString>() && newContent.toString().isEmpty()) return;
-    if (newContent.canConvert<QImage>() && newContent.value<QImage>().isNull()) return;
+    const int row = index.model() == searchResults ? searchResults->sourceRow(index.row()) : index.row();
+    if (row < 0) return;
+    activateRow(row);
+    hide();
+}
 
+void MainWindow::activateRow(int row)
+{
+    const QVariant data = historyModel->contentAt(row);
+    if (!data.isValid())
+        return;
 
-    if (history.isEmpty() || history.front() != newContent) {
-        history.push_front(newContent);
-        if (history.size() > 20) {
-            history.pop_back();
-        }
-        updateListWidget();
+    // The watcher would transfer our own data straight back; move the
+    // entry to the front here instead, as a capture of it would
+    if (selectionsWatched)
+        selectionWatcher->ignoreNextChange(SelectionWatcher::Clipboard);
+    // Each paste target is encoded once and then served from the cache
+    clipboard->setMimeData(new EntryMimeData(historyModel->contentKeyAt(row), data,
+                                             historyModel->originalFormatsAt(row), encodedCache));
+    if (selectionsWatched)
+        historyModel->prepend(CapturedContent::known(data, historyModel->contentKeyAt(row)));
+}
+
+void MainWindow::onHotkeyPressed(const QString &action)
+{
+    const qint64 emittedAt = Trace::takeMark(Trace::HotkeyEmittedMark);
+    if (emittedAt != 0) {
+        Trace::record(Trace::HotkeyDelivery, emittedAt, Trace::now());
     }
+    hotkeyReceivedAt = Trace::takeMark(Trace::HotkeyReceivedMark);
+
+    if (action == "toggle") {
+        toggleVisibility();
+    } else if (action == "clear") {
+        clearHistory();
+    } else if (action == "quit") {
+        qApp->quit();
+    } else {
+        qWarning("Unknown hotkey action \"%s\"", qPrintable(action));
+    }
+}
+
+void MainWindow::onClipboardCaptured(const CapturedContent &content, const OriginalFormats::List &originals)
+{
+    // Fingerprinted on the capture worker; duplicates move to the front
+    historyModel->prepend(content, originals);
 }
 
 // ---------------------
@@ -151,6 +354,10 @@ void MainWindow::createTrayIcon()
     trayIcon->setIcon(QIcon::fromTheme("edit-copy"));
     trayIcon->setToolTip("LinClip Clipboard Manager");
     QMenu *menu = new QMenu(this);
+    QAction *statsAction = new QAction("Stats", this);
+    connect(statsAction, &QAction::triggered, this, &MainWindow::showStats);
+    menu->addAction(statsAction);
+    menu->addSeparator();
     QAction *quitAction = new QAction("Quit", this);
     connect(quitAction, &QAction::triggered, qApp, &QApplication::quit);
     menu->addAction(quitAction);
@@ -161,44 +368,136 @@ void MainWindow::createTrayIcon()
 // ---------------------
 // Helpers
 // ---------------------
-void MainWindow::updateListWidget()
-{
-    listWidget->clear();
-    for (const QVariant &itemData : history) {
-        QListWidgetItem *listItem = new QListWidgetItem();
-
-        if (itemData.canConvert<QImage>()) {
-            QImage img = itemData.value<QImage>();
-            QIcon icon(QPixmap::fromImage(img.scaled(64, 64, Qt::KeepAspectRatio, Qt::SmoothTransformation)));
-            listItem->setIcon(icon);
-            listItem->setText(QString("[Image %1x%2]").arg(img.width()).arg(img.height()));
-        } else if (itemData.canConvert<QString>()) {
-            QString fullText = itemData.value<QString>();
-            QString firstLine = fullText.split('\n').first().trimmed();
-            listItem->setText(firstLine);
-        }
-
-        listItem->setData(Qt::UserRole, itemData);
-        listWidget->addItem(listItem);
-    }
-}
-
 void MainWindow::toggleVisibility()
 {
     if (isVisible()) {
         hide();
     } else {
-        updateListWidget();
+        // The popup was reset when it was hidden and has been kept laid
+        // out since; only the position changes here
+        const qint64 started = Trace::now();
         move(QCursor::pos());
         activateWindow();
         raise();
         show();
+        searchEdit->setFocus();
+        paintPendingSince = Trace::now();
+        Trace::record(Trace::PopupShow, started, paintPendingSince);
+    }
+}
+
+void MainWindow::showModel(QAbstractItemModel *model)
+{
+    if (listView->model() == model) return;
+
+    // setModel() leaves the old selection model behind
+    QItemSelectionModel *oldSelection = listView->selectionModel();
+    listView->setModel(model);
+    delete oldSelection;
+}
+
+void MainWindow::onSearchTextChanged(const QString &text)
+{
+    if (text.trimmed().isEmpty()) {
+        showModel(historyModel);
+        return;
+    }
+    historyModel->searchIndex()->search(text);
+}
+
+void MainWindow::onSearchResults(const QString &query, const QList<quint64> &keys)
+{
+    // Results for text that has since been edited are of no use
+    if (query != searchEdit->text()) return;
+
+    searchResults->setResults(keys);
+    showModel(searchResults);
+    if (!keys.isEmpty()) {
+        listView->setCurrentIndex(searchResults->index(0));
     }
 }
 
 void MainWindow::clearHistory()
 {
-    history.clear();
-    updateListWidget();
+    historyModel->clear();
+    encodedCache->clear();
     statusBar()->showMessage("History cleared.", 2000);
 }
+
+void MainWindow::showStats()
+{
+    static const struct {
+        Trace::Stage stage;
+        const char *label;
+    } latencyRows[] = {
+        { Trace::StartupReady, "Startup: process start to ready" },
+        { Trace::PopupWarm, "Startup: popup warm-up" },
+        { Trace::HotkeyEvent, "Hotkey: X event to signal" },
+        { Trace::HotkeyDelivery, "Hotkey: signal to GUI thread" },
+        { Trace::PopupShow, "Popup: show" },
+        { Trace::PopupPaint, "Popup: first paint" },
+        { Trace::HotkeyToPaint, "Hotkey to first paint" },
+        { Trace::CaptureDebounce, "Capture: debounce" },
+        { Trace::CaptureFetch, "Capture: clipboard read" },
+        { Trace::CaptureDecode, "Capture: image decode" },
+        { Trace::CaptureTotal, "Capture: change to entry" },
+        { Trace::StoreText, "Store text entry" },
+        { Trace::StoreImage, "Compress image entry" },
+        { Trace::PasteEncode, "Paste: encode for target" },
+        { Trace::PasteServe, "Paste: request to data" },
+    };
+
+    const QList<Trace::Event> events = Trace::snapshot();
+    const QLocale locale;
+    auto milliseconds = [](qint64 ns) { return QString("%1 ms").arg(ns / 1e6, 0, 'f', 2); };
+
+    QString latency = "<table><tr><th align=left>Stage</th><th align=right>Count</th>"
+                      "<th align=right>p50</th><th align=right>p99</th></tr>";
+    for (const auto &row : latencyRows) {
+        const Trace::Summary summary = Trace::summarize(events, row.stage);
+        if (summary.count == 0) continue;
+        latency += QString("<tr><td>%1</td><td align=right>%2</td><td align=right>%3</td><td align=right>%4</td></tr>")
+                       .arg(row.label).arg(summary.count).arg(milliseconds(summary.p50), milliseconds(summary.p99));
+    }
+    latency += "</table>";
+
+    const HistoryModel::MemoryStats stats = historyModel->memoryStats();
+    const Trace::Summary textSizes = Trace::summarize(events, Trace::StoreText, true);
+    const Trace::Summary imageSizes = Trace::summarize(events, Trace::StoreImage, true);
+    const QString memory = QString(
+        "<table>"
+        "<tr><td>Text entries:</td><td align=right>%1</td><td align=right>%2</td></tr>"
+        "<tr><td>Image entries:</td><td align=right>%3</td><td align=right>%4 compressed</td></tr>"
+        "<tr><td>Shared image tiles:</td><td align=right>%5</td><td align=right>%6 saved</td></tr>"
+        "<tr><td>Waiting for compression:</td><td></td><td align=right>%7</td></tr>"
+        "<tr><td>Decoded image cache:</td><td></td><td align=right>%8 of %9</td></tr>"
+        "<tr><td>Entry records:</td><td></td><td align=right>%10</td></tr>"
+        "<tr><td>Recent text entry size:</td><td></td><td align=right>%11 p50, %12 p99</td></tr>"
+        "<tr><td>Recent image entry size:</td><td></td><td align=right>%13 p50, %14 p99</td></tr>"
+        "</table>"
+        "<p>%15</p>")
+        .arg(stats.textEntries)
+        .arg(locale.formattedDataSize(stats.textBytes))
+        .arg(stats.imageEntries)
+        .arg(locale.formattedDataSize(stats.compressedImageBytes))
+        .arg(stats.imageTiles)
+        .arg(locale.formattedDataSize(stats.sharedTileSavings))
+        .arg(locale.formattedDataSize(stats.pendingImageBytes))
+        .arg(locale.formattedDataSize(stats.decodedImageBytes))
+        .arg(locale.formattedDataSize(stats.decodedImageBudget))
+        .arg(locale.formattedDataSize(stats.recordBytes))
+        .arg(locale.formattedDataSize(textSizes.p50))
+        .arg(locale.formattedDataSize(textSizes.p99))
+        .arg(locale.formattedDataSize(imageSizes.p50))
+        .arg(locale.formattedDataSize(imageSizes.p99))
+        .arg(stats.persistent ? QString("Entries are stored on disk and paged in on demand.")
+                              : QString("History is kept in memory only."));
+
+    const QString tracePath = qEnvironmentVariable("LINCLIP_TRACE");
+    const QString traceNote = tracePath.isEmpty()
+        ? QString("Set LINCLIP_TRACE=file.json to save a Chrome trace on exit.")
+        : QString("A Chrome trace will be written to %1 on exit.").arg(tracePath.toHtmlEscaped());
+
+    QMessageBox::information(nullptr, "LinClip Stats",
+                             "<h3>Latency</h3>" + latency + "<h3>Memory</h3>" + memory + "<p>" + traceNote + "</p>");
+}
@@ -1,16 +1,28 @@
 #pragma once
 
 #include <QMainWindow>
-#include <QList>
-#include <QVariant> // ADDED: For storing text or images
+#include <QPointer>
+
+#include "originalformats.h"
+
+#include <memory>
 
 // Forward declarations to keep header clean
-class QListWidget;
-class QListWidgetItem;
+class QAbstractItemModel;
+class QLineEdit;
+class QListView;
+class QModelIndex;
+class HistoryModel;
+class SearchResultsModel;
 class QClipboard;
+class ClipboardCapture;
+struct CapturedContent;
+class ControlServer;
+class EncodedCache;
 class QSystemTrayIcon;
 class QThread;
 class GlobalHotkeyManager;
+class SelectionWatcher;
 
 class MainWindow : public QMainWindow
 {
@@ -20,24 +32,70 @@ public:
     MainWindow(QWidget *parent = nullptr);
     ~MainWindow();
 
+    // Between deferred startup steps
+    static constexpr int StartupStepMs = 20;
+
+    // Whether deferred startup has finished (see ready())
+    bool isReady() const { return startupFinished; }
+
+signals:
+    // The control socket and the tray icon are up and the hidden popup is
+    // warm. Hotkeys and selection watching start with the window.
+    void ready();
+
+protected:
+    bool eventFilter(QObject *watched, QEvent *event) override;
+    void hideEvent(QHideEvent *event) override;
+
 private slots:
-    void onItemActivated(QListWidgetItem *item);
-    void onClipboardChanged();
+    void onItemActivated(const QModelIndex &index);
+    // Puts a history row on the clipboard
+    void activateRow(int row);
+    void onClipboardCaptured(const CapturedContent &content, const OriginalFormats::List &originals);
+    void onHotkeyPressed(const QString &action);
     void toggleVisibility();
     void clearHistory();
+    void showStats();
+    void onSearchTextChanged(const QString &text);
+    void onSearchResults(const QString &query, const QList<quint64> &keys);
 
 private:
+    void startHotkeys();
+    void startSelectionWatcher();
+    // Startup work that can wait until the event loop runs
+    bool runStartupStep();
+    void warmPopup();
     void createTrayIcon();
-    void updateListWidget(); // ADDED: Helper to refresh the UI
+    void showModel(QAbstractItemModel *model);
 
-    QListWidget *listWidget;
+    QLineEdit *searchEdit;
+    QListView *listView;
     QClipboard *clipboard;
-    QSystemTrayIcon *trayIcon;
+    ClipboardCapture *capture;
+    ControlServer *controlServer = nullptr;
+    QSystemTrayIcon *trayIcon = nullptr; // Created by deferred startup
+
+    // History entries (text or image), newest first
+    HistoryModel *historyModel;
+    // Ranked matches while the search box is not empty
+    SearchResultsModel *searchResults;
+    // Activated entries encoded per paste target; shared with the
+    // clipboard's EntryMimeData, which may outlive the window
+    std::shared_ptr<EncodedCache> encodedCache;
+
+    int startupStep = 0;
+    bool startupFinished = false;
+
+    // Latency tracing: set while the popup waits for its first paint
+    qint64 hotkeyReceivedAt = 0;
+    qint64 paintPendingSince = 0;
 
-    // --- MODIFIED: History now stores QVariant (text or image) ---
-    QList<QVariant> history;
+    QPointer<QThread> hotkeyThread;
+    QPointer<GlobalHotkeyManager> hotkeyManager;
 
-    // Hotkey manager members (no changes here)
-    QThread* hotkeyThread;
-    GlobalHotkeyManager* hotkeyManager;
+    // Native selection capture; null when disabled. Once it is watching,
+    // QClipboard is only used to paste.
+    QPointer<QThread> selectionThread;
+    SelectionWatcher *selectionWatcher = nullptr;
+    bool selectionsWatched = false;
 };
@@ -0,0 +1,41 @@
+#include "originalformats.h"
+
+#include <QDataStream>
+
+namespace OriginalFormats {
+
+const QStringList &kept()
+{
+    static const QStringList formats = {
+        QStringLiteral("text/html"),
+        QStringLiteral("text/rtf"),
+        QStringLiteral("application/rtf"),
+        QStringLiteral("text/richtext"),
+        QStringLiteral("text/uri-list"),
+        QStringLiteral("x-special/gnome-copied-files"),
+    };
+    return formats;
+}
+
+QByteArray serialize(const List &formats)
+{
+    QByteArray data;
+    QDataStream stream(&data, QIODevice::WriteOnly);
+    stream.setVersion(QDataStream::Qt_6_0);
+    stream << formats;
+    return data;
+}
+
+List deserialize(const char *data, qsizetype size)
+{
+    List formats;
+    if (size <= 0)
+        return formats;
+    const QByteArray bytes = QByteArray::fromRawData(data, size);
+    QDataStream stream(bytes);
+    stream.setVersion(QDataStream::Qt_6_0);
+    stream >> formats;
+    return stream.status() == QDataStream::Ok ? formats : List();
+}
+
+} // namespace OriginalFormats
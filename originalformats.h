@@ -0,0 +1,29 @@
+#pragma once
+
+#include <QByteArray>
+#include <QList>
+#include <QPair>
+#include <QString>
+#include <QStringList>
+
+// The formats a clip was offered in besides the text or image it is kept
+// as: HTML, rich text, file lists. They are captured with it and offered
+// again when the entry is pasted, so that pasting into a rich editor or a
+// file manager works as it did from the source application.
+namespace OriginalFormats {
+
+// MIME type and data, in the order the source offered them
+using List = QList<QPair<QString, QByteArray>>;
+
+// For all of a clip's original formats together; beyond it the rest are
+// dropped
+constexpr qint64 SizeLimit = 4 * 1024 * 1024;
+
+// The MIME types worth keeping, which are also their X target names
+const QStringList &kept();
+
+QByteArray serialize(const List &formats);
+List deserialize(const char *data, qsizetype size);
+inline List deserialize(const QByteArray &data) { return deserialize(data.constData(), data.size()); }
+
+} // namespace OriginalFormats
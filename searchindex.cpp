@@ -0,0 +1,369 @@
+#include "searchindex.h"
+
+#include <QMetaObject>
+
+#include <algorithm>
+
+namespace {
+
+// How often long loops look at the cancellation flag
+constexpr int CancelCheckInterval = 512;
+// Rebuild postings once this many documents are dead (and a quarter of all)
+constexpr int CompactionThreshold = 1024;
+
+struct Hit {
+    quint64 key;
+    quint32 document;
+    int quality; // 3 prefix, 2 word start, 1 inside, 0 fuzzy
+    quint64 order;
+};
+
+inline quint64 trigram(const QChar *p)
+{
+    return quint64(p[0].unicode()) << 32 | quint64(p[1].unicode()) << 16 | quint64(p[2].unicode());
+}
+
+std::vector<quint64> trigrams(QStringView text)
+{
+    std::vector<quint64> grams;
+    if (text.size() < 3)
+        return grams;
+    grams.reserve(size_t(text.size() - 2));
+    for (qsizetype i = 0; i + 3 <= text.size(); ++i)
+        grams.push_back(trigram(text.data() + i));
+    std::sort(grams.begin(), grams.end());
+    grams.erase(std::unique(grams.begin(), grams.end()), grams.end());
+    return grams;
+}
+
+int matchQuality(QStringView text, qsizetype pos)
+{
+    if (pos == 0)
+        return 3;
+    return text.at(pos - 1).isLetterOrNumber() ? 1 : 2;
+}
+
+// Every character of needle appears in haystack, in order
+bool fuzzyMatch(QStringView haystack, QStringView needle)
+{
+    qsizetype n = 0;
+    for (qsizetype h = 0; h < haystack.size() && n < needle.size(); ++h) {
+        if (haystack.at(h) == needle.at(n))
+            ++n;
+    }
+    return n == needle.size();
+}
+
+} // namespace
+
+SearchIndex::SearchIndex(QObject *parent)
+    : QObject(parent)
+{
+    // One worker: a new query cancels the previous one rather than racing it
+    m_pool.setMaxThreadCount(1);
+}
+
+SearchIndex::~SearchIndex()
+{
+    ++m_generation;
+    m_pool.waitForDone();
+}
+
+void SearchIndex::add(quint64 key, quint64 order, QStringView text, const TextReader &reader)
+{
+    const QString folded = text.left(IndexedLength).toString().toCaseFolded();
+    const std::vector<quint64> grams = trigrams(folded);
+
+    QWriteLocker locker(&m_lock);
+    const auto existing = m_documentByKey.constFind(key);
+    if (existing != m_documentByKey.cend()) {
+        Document &old = m_documents[existing.value()];
+        old.live = false;
+        old.text.clear();
+        old.reader = nullptr;
+        ++m_deadDocuments;
+    }
+
+    const quint32 id = quint32(m_documents.size());
+    m_documents.push_back({ key, order, folded, text.size() > IndexedLength ? reader : TextReader(), true });
+    m_documentByKey.insert(key, id);
+    // Ids only grow, so appending keeps every postings list sorted
+    for (quint64 gram : grams)
+        m_postings[gram].push_back(id);
+}
+
+void SearchIndex::remove(quint64 key)
+{
+    bool needsCompaction = false;
+    {
+        QWriteLocker locker(&m_lock);
+        const auto it = m_documentByKey.constFind(key);
+        if (it == m_documentByKey.cend())
+            return;
+
+        // Postings keep the id until the next compaction; queries skip it
+        Document &document = m_documents[it.value()];
+        document.live = false;
+        document.text.clear();
+        document.reader = nullptr;
+        m_documentByKey.erase(it);
+        ++m_deadDocuments;
+        needsCompaction = m_deadDocuments >= CompactionThreshold
+                          && size_t(m_deadDocuments) * 4 >= m_documents.size();
+    }
+
+    if (needsCompaction && !m_compacting.exchange(true)) {
+        m_pool.start([this]() {
+            compact();
+            m_compacting = false;
+        });
+    }
+}
+
+void SearchIndex::setOrder(quint64 key, quint64 order)
+{
+    QWriteLocker locker(&m_lock);
+    const auto it = m_documentByKey.constFind(key);
+    if (it != m_documentByKey.cend())
+        m_documents[it.value()].order = order;
+}
+
+void SearchIndex::setReader(quint64 key, const TextReader &reader)
+{
+    QWriteLocker locker(&m_lock);
+    const auto it = m_documentByKey.constFind(key);
+    if (it != m_documentByKey.cend() && m_documents[it.value()].reader)
+        m_documents[it.value()].reader = reader;
+}
+
+void SearchIndex::clear()
+{
+    ++m_generation;
+    {
+        QWriteLocker locker(&m_lock);
+        m_documents.clear();
+        m_documentByKey.clear();
+        m_postings.clear();
+        m_deadDocuments = 0;
+    }
+
+    // The search just cancelled would otherwise never answer
+    QMutexLocker locker(&m_pendingMutex);
+    if (!m_pending)
+        return;
+    const QString query = m_pendingQuery;
+    const int limit = m_pendingLimit;
+    locker.unlock();
+    search(query, limit);
+}
+
+void SearchIndex::search(const QString &query, int limit)
+{
+    {
+        QMutexLocker locker(&m_pendingMutex);
+        m_pendingQuery = query;
+        m_pendingLimit = limit;
+        m_pending = true;
+    }
+
+    // Queries still queued see the new generation and return at once
+    const quint64 generation = ++m_generation;
+    m_pool.start([this, query, limit, generation]() {
+        auto cancelled = [this, generation]() { return m_generation.load() != generation; };
+        if (cancelled())
+            return;
+        const QList<quint64> keys = this->query(query, limit, cancelled);
+        if (cancelled())
+            return;
+        QMetaObject::invokeMethod(this, [this, query, keys, generation]() {
+            if (m_generation.load() != generation)
+                return;
+            {
+                QMutexLocker locker(&m_pendingMutex);
+                m_pending = false;
+            }
+            emit resultsReady(query, keys);
+        }, Qt::QueuedConnection);
+    });
+}
+
+QList<quint64> SearchIndex::query(const QString &query, int limit,
+                                  const std::function<bool()> &cancelled) const
+{
+    // Nothing past IndexedLength is indexed, so longer queries are cut there
+    const QString folded = query.trimmed().left(IndexedLength).toCaseFolded();
+    if (folded.isEmpty() || limit <= 0)
+        return QList<quint64>();
+
+    QReadLocker locker(&m_lock);
+    std::vector<Hit> hits;
+    std::vector<bool> found(m_documents.size(), false);
+    int steps = 0;
+    auto shouldStop = [&]() {
+        return cancelled && ++steps % CancelCheckInterval == 0 && cancelled();
+    };
+
+    auto tryExact = [&](quint32 id) {
+        const Document &document = m_documents[id];
+        if (!document.live)
+            return false;
+        // QStringView::indexOf uses Qt's vectorized string search
+        const qsizetype pos = QStringView(document.text).indexOf(folded);
+        if (pos < 0)
+            return false;
+        hits.push_back({ document.key, id, matchQuality(document.text, pos), document.order });
+        found[id] = true;
+        return true;
+    };
+
+    if (folded.size() < 3) {
+        // Too short for trigrams: a straight scan is still cheap at this
+        // document size
+        for (quint32 id = 0; id < m_documents.size(); ++id) {
+            if (shouldStop())
+                return QList<quint64>();
+            tryExact(id);
+        }
+    } else {
+        const std::vector<quint64> grams = trigrams(folded);
+        std::vector<const Postings *> lists;
+        lists.reserve(grams.size());
+        for (quint64 gram : grams) {
+            const auto it = m_postings.constFind(gram);
+            if (it != m_postings.cend())
+                lists.push_back(&it.value());
+        }
+
+        if (lists.size() == grams.size()) {
+            // Intersect starting from the rarest trigram
+            std::sort(lists.begin(), lists.end(), [](const Postings *a, const Postings *b) {
+                return a->size() < b->size();
+            });
+            Postings candidates = *lists.front();
+            Postings narrowed;
+            for (size_t i = 1; i < lists.size() && !candidates.empty(); ++i) {
+                narrowed.clear();
+                std::set_intersection(candidates.begin(), candidates.end(),
+                                      lists[i]->begin(), lists[i]->end(), std::back_inserter(narrowed));
+                candidates.swap(narrowed);
+            }
+            for (quint32 id : candidates) {
+                if (shouldStop())
+                    return QList<quint64>();
+                tryExact(id);
+            }
+        }
+
+        if (int(hits.size()) < limit && !lists.empty()) {
+            // Fuzzy fallback: documents sharing at least half the trigrams
+            std::vector<quint16> shared(m_documents.size(), 0);
+            for (const Hit &hit : hits)
+                shared[hit.document] = quint16(0xffff); // Already an exact hit
+            for (const Postings *list : lists) {
+                for (quint32 id : *list) {
+                    if (shared[id] < 0xfffe)
+                        ++shared[id];
+                }
+            }
+            const size_t needed = std::max<size_t>(1, (grams.size() + 1) / 2);
+            for (quint32 id = 0; id < shared.size(); ++id) {
+                if (shouldStop())
+                    return QList<quint64>();
+                if (shared[id] == 0xffff || shared[id] < needed || !m_documents[id].live)
+                    continue;
+                if (fuzzyMatch(m_documents[id].text, folded))
+                    hits.push_back({ m_documents[id].key, id, 0, m_documents[id].order });
+            }
+        }
+    }
+
+    if (int(hits.size()) < limit) {
+        // The rest of long documents, read back and scanned without the
+        // lock so that add() is not held up. Fuzzy hits are scanned again:
+        // an exact match ranks higher.
+        struct Tail {
+            quint64 key;
+            quint64 order;
+            TextReader reader;
+        };
+        std::vector<Tail> tails;
+        for (quint32 id = 0; id < m_documents.size(); ++id) {
+            const Document &document = m_documents[id];
+            if (document.live && document.reader && !found[id])
+                tails.push_back({ document.key, document.order, document.reader });
+        }
+        locker.unlock();
+
+        for (const Tail &tail : tails) {
+            if (cancelled && cancelled())
+                return QList<quint64>();
+            const QString text = tail.reader();
+            if (text.size() <= IndexedLength)
+                continue;
+            // Overlaps the indexed start by all but one character of the
+            // query, plus the one before to rank the match
+            const qsizetype start = IndexedLength - folded.size();
+            const QString rest = QStringView(text).mid(start).toString().toCaseFolded();
+            const qsizetype pos = QStringView(rest).indexOf(folded, 1);
+            if (pos < 0)
+                continue;
+            const auto fuzzyHit = std::find_if(hits.begin(), hits.end(), [&](const Hit &hit) {
+                return hit.key == tail.key;
+            });
+            if (fuzzyHit != hits.end())
+                fuzzyHit->quality = matchQuality(rest, pos);
+            else
+                hits.push_back({ tail.key, 0, matchQuality(rest, pos), tail.order });
+        }
+    }
+
+    // Best match quality first, then most recently copied
+    const size_t count = std::min(hits.size(), size_t(limit));
+    std::partial_sort(hits.begin(), hits.begin() + count, hits.end(), [](const Hit &a, const Hit &b) {
+        return a.quality != b.quality ? a.quality > b.quality : a.order > b.order;
+    });
+
+    QList<quint64> keys;
+    keys.reserve(qsizetype(count));
+    for (size_t i = 0; i < count; ++i)
+        keys.append(hits[i].key);
+    return keys;
+}
+
+void SearchIndex::compact()
+{
+    QWriteLocker locker(&m_lock);
+
+    // Renumber live documents; the mapping is monotonic, so postings stay sorted
+    std::vector<quint32> remap(m_documents.size(), quint32(-1));
+    std::vector<Document> live;
+    live.reserve(m_documents.size() - size_t(m_deadDocuments));
+    for (size_t id = 0; id < m_documents.size(); ++id) {
+        if (m_documents[id].live) {
+            remap[id] = quint32(live.size());
+            live.push_back(std::move(m_documents[id]));
+        }
+    }
+
+    for (auto it = m_postings.begin(); it != m_postings.end();) {
+        Postings &list = it.value();
+        size_t out = 0;
+        for (quint32 id : list) {
+            if (remap[id] != quint32(-1))
+                list[out++] = remap[id];
+        }
+        list.resize(out);
+        if (list.empty()) {
+            it = m_postings.erase(it);
+        } else {
+            list.shrink_to_fit();
+            ++it;
+        }
+    }
+
+    m_documents.swap(live);
+    m_documentByKey.clear();
+    for (size_t id = 0; id < m_documents.size(); ++id)
+        m_documentByKey.insert(m_documents[id].key, quint32(id));
+    m_deadDocuments = 0;
+}
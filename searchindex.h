@@ -0,0 +1,97 @@
+#pragma once
+
+#include <QHash>
+#include <QList>
+#include <QMutex>
+#include <QObject>
+#include <QReadWriteLock>
+#include <QString>
+#include <QStringView>
+#include <QThreadPool>
+
+#include <atomic>
+#include <functional>
+#include <vector>
+
+// Incremental trigram index over the text entries of the history.
+//
+// Each document is the case-folded start of an entry (IndexedLength
+// characters) plus its recency order. Postings map a trigram to the sorted
+// list of documents containing it; a query intersects the postings of its
+// trigrams, verifies the candidates with a substring search and ranks them
+// by match position and recency. Queries the postings cannot answer fall
+// back to a fuzzy (in-order subsequence) match over documents sharing at
+// least half of the query's trigrams.
+//
+// Only the start is indexed, so that the postings stay small. Documents
+// longer than that are added with a TextReader; when the index finds fewer
+// than the limit, the rest of their text is read back and scanned
+// linearly, without holding the lock.
+//
+// add()/remove()/setOrder() are cheap and meant to be called from the GUI
+// thread as the history changes; search() runs on a worker and cancels
+// whatever query was still running.
+class SearchIndex : public QObject
+{
+    Q_OBJECT
+
+public:
+    static constexpr int IndexedLength = 256;
+    static constexpr int DefaultLimit = 200;
+
+    explicit SearchIndex(QObject *parent = nullptr);
+    ~SearchIndex();
+
+    // Returns the whole text of a document; called on the worker
+    using TextReader = std::function<QString()>;
+
+    // All thread-safe. The reader is only kept if text is longer than
+    // IndexedLength.
+    void add(quint64 key, quint64 order, QStringView text, const TextReader &reader = {});
+    // For a document that kept one, when its text has moved
+    void setReader(quint64 key, const TextReader &reader);
+    void remove(quint64 key);
+    void setOrder(quint64 key, quint64 order);
+    // Runs the search still pending, if any, again
+    void clear();
+
+    // Asynchronous: emits resultsReady() unless a newer search() came first
+    void search(const QString &query, int limit = DefaultLimit);
+
+    // The synchronous core of search(): keys of the best matches, best
+    // first. Stops early (returning nothing) once cancelled() is true.
+    QList<quint64> query(const QString &query, int limit,
+                         const std::function<bool()> &cancelled = {}) const;
+
+signals:
+    void resultsReady(const QString &query, const QList<quint64> &keys);
+
+private:
+    struct Document {
+        quint64 key;
+        quint64 order;
+        QString text; // Case-folded, at most IndexedLength characters
+        TextReader reader; // Only for longer documents
+        bool live;
+    };
+
+    using Postings = std::vector<quint32>;
+
+    void compact();
+
+    std::vector<Document> m_documents;
+    QHash<quint64, quint32> m_documentByKey;
+    QHash<quint64, Postings> m_postings; // Trigram -> ascending document ids
+    int m_deadDocuments = 0;
+
+    mutable QReadWriteLock m_lock;
+    QThreadPool m_pool;
+    std::atomic<quint64> m_generation { 0 };
+    std::atomic<bool> m_compacting { false };
+
+    // The search whose results have not been emitted yet
+    QMutex m_pendingMutex;
+    QString m_pendingQuery;
+    int m_pendingLimit = 0;
+    bool m_pending = false;
+};
@@ -0,0 +1,40 @@
+#include "searchresultsmodel.h"
+#include "historymodel.h"
+
+SearchResultsModel::SearchResultsModel(HistoryModel *source, QObject *parent)
+    : QAbstractListModel(parent)
+    , m_source(source)
+{
+    // Thumbnails finishing in the source need a repaint here as well
+    connect(m_source, &HistoryModel::dataChanged, this,
+            [this](const QModelIndex &, const QModelIndex &, const QList<int> &roles) {
+        if (!m_keys.isEmpty())
+            emit dataChanged(index(0), index(m_keys.size() - 1), roles);
+    });
+}
+
+void SearchResultsModel::setResults(const QList<quint64> &keys)
+{
+    beginResetModel();
+    m_keys = keys;
+    endResetModel();
+}
+
+int SearchResultsModel::sourceRow(int row) const
+{
+    return (row >= 0 && row < m_keys.size()) ? m_source->rowForKey(m_keys.at(row)) : -1;
+}
+
+int SearchResultsModel::rowCount(const QModelIndex &parent) const
+{
+    return parent.isValid() ? 0 : m_keys.size();
+}
+
+QVariant SearchResultsModel::data(const QModelIndex &index, int role) const
+{
+    if (!index.isValid())
+        return QVariant();
+
+    const int row = sourceRow(index.row());
+    return row < 0 ? QVariant() : m_source->data(m_source->index(row), role);
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <QAbstractListModel>
+#include <QList>
+
+class HistoryModel;
+
+// The rows of a search: a list of entry fingerprints, best match first,
+// shown through the HistoryModel so labels and thumbnails come from the
+// same place as in the full list.
+class SearchResultsModel : public QAbstractListModel
+{
+    Q_OBJECT
+
+public:
+    explicit SearchResultsModel(HistoryModel *source, QObject *parent = nullptr);
+
+    void setResults(const QList<quint64> &keys);
+    // Row of the result in the HistoryModel, or -1 if it is gone
+    int sourceRow(int row) const;
+
+    int rowCount(const QModelIndex &parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
+
+private:
+    HistoryModel *m_source;
+    QList<quint64> m_keys;
+};
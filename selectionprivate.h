@@ -0,0 +1,131 @@
+#pragma once
+
+#include "originalformats.h"
+
+#include <QByteArray>
+#include <QString>
+#include <QStringList>
+#include <atomic>
+#include <memory>
+#include <vector>
+
+#include <X11/Xlib.h>
+
+class SelectionPayload;
+
+// This class holds all X11-specific details of SelectionWatcher.
+// It is hidden from the rest of the project by only being included in the .cpp.
+class SelectionPrivate {
+public:
+    // Accumulates a transfer, in memory up to SpillThreshold and in a memfd
+    // beyond it. Refuses more data once the size limit is exceeded.
+    class Sink {
+    public:
+        ~Sink();
+        void reset(qint64 limit);
+        bool append(const char *data, qsizetype size);
+        bool overLimit() const { return m_size > m_limit; }
+        // Hands the data over and empties the sink; null on failure
+        std::shared_ptr<SelectionPayload> finish();
+
+    private:
+        QByteArray m_buffer;
+        int m_fd = -1;
+        qsizetype m_size = 0;
+        qint64 m_limit = 0;
+        bool m_failed = false;
+    };
+
+    // One transfer runs at a time: the chosen target, then the original
+    // formats offered along with it, one after the other
+    struct Transfer {
+        enum Stage { Idle, Targets, Data, Incremental };
+        Stage stage = Idle;
+        int selection = 0;  // SelectionWatcher::Selection
+        Atom property = 0;
+        Atom target = 0;
+        Time time = 0;
+        qint64 started = 0;      // Trace::now()
+        qint64 lastProgress = 0; // Trace::now()
+        Sink sink;
+
+        // Set once the chosen target is in
+        std::shared_ptr<SelectionPayload> payload;
+        QString format;
+        std::vector<Atom> originalTargets; // Still to fetch
+        OriginalFormats::List originals;
+        qint64 originalBytes = 0;
+    };
+
+    struct Result {
+        int selection = 0;
+        QString format;
+        std::shared_ptr<SelectionPayload> payload;
+        OriginalFormats::List originals;
+    };
+
+    SelectionPrivate();
+    ~SelectionPrivate();
+
+    bool open(int selections);
+
+    // True when result holds a finished transfer
+    bool handleEvent(const XEvent &event, Result *result);
+    void startDueTransfers(qint64 now);
+    // True when result holds a transfer cut short by the timeout that can
+    // still be delivered
+    bool checkTimeout(qint64 now, Result *result);
+    // For poll(): until the next debounce or transfer deadline, or -1
+    int pollTimeout(qint64 now) const;
+
+    static std::shared_ptr<SelectionPayload> makePayload(const QByteArray &bytes, int fd, qsizetype size);
+
+    Display *display = nullptr;
+    Window window = 0;
+    int fixesEventBase = 0;
+    std::atomic<int> *ignored = nullptr; // SelectionWatcher::m_ignored
+    QStringList imageFormats;            // Preferred first
+    qint64 textLimit = 0;
+    qint64 imageLimit = 0;
+
+    // eventfd used by stop() to wake the poll() in run()
+    int wakeFd = -1;
+
+private:
+    Atom selectionAtom(int selection) const;
+    int selectionFor(Atom atom) const;
+    Atom chooseTarget(const Atom *targets, unsigned long count) const;
+    QString formatFor(Atom target) const;
+    qint64 limitFor(Atom target) const;
+    bool isOriginal(Atom target) const;
+    void requestData(Atom target);
+    // Reads and deletes the transfer property into the sink, in pieces.
+    // Returns the property's type, or 0 if it could not be read.
+    Atom readProperty(unsigned long *itemCount);
+    bool finishTransfer(Result *result);
+    // Requests the next original format, or hands the transfer over
+    bool nextOriginal(Result *result);
+    // Abandons the transfer, or once the chosen target is in, the
+    // original formats still to come
+    bool failTransfer(const char *reason, Result *result);
+    void abortTransfer(const char *reason);
+
+    Atom clipboardAtom = 0;
+    Atom targetsAtom = 0;
+    Atom incrAtom = 0;
+    Atom utf8Atom = 0;
+    Atom textPlainUtf8Atom = 0;
+    Atom uriListAtom = 0;
+    std::vector<Atom> imageAtoms;
+    std::vector<Atom> originalAtoms; // OriginalFormats::kept()
+    // Rotated per transfer, so that late chunks of an abandoned INCR
+    // transfer never land in the next one
+    Atom propertyAtoms[4] = {};
+    unsigned int transferCount = 0;
+
+    Transfer transfer;
+    // Per selection (Clipboard, Primary): when its debounce ends (Trace::now(),
+    // 0 if nothing is pending) and the server time of the change
+    qint64 pendingUntil[2] = { 0, 0 };
+    Time pendingTime[2] = { 0, 0 };
+};
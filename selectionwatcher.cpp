@@ -0,0 +1,627 @@
+// --- 1. Include your Qt-facing headers FIRST ---
+#include "selectionwatcher.h"
+#include "selectionprivate.h"
+#include "trace.h"
+#include <iostream>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+// --- 2. Then include X11 ---
+#include <X11/Xatom.h>
+#include <X11/Xlib.h>
+#include <X11/extensions/Xfixes.h>
+
+// --- 3. Clean up all common conflicting X11 macros ---
+#undef None
+#undef Bool
+#undef Status
+#undef Success
+#undef GrayScale
+#undef Above
+#undef Below
+
+namespace {
+
+// What None and Success stand for
+constexpr unsigned long NoneValue = 0;
+constexpr int SuccessValue = 0;
+
+// XGetWindowProperty() reads in 32-bit units: 256 KiB per round trip
+constexpr long ReadChunkLongs = 64 * 1024;
+
+constexpr qint64 NsPerMs = 1000000;
+
+int slotOf(int selection)
+{
+    return selection == SelectionWatcher::Primary ? 1 : 0;
+}
+
+bool writeAll(int fd, const char *data, qsizetype size)
+{
+    while (size > 0) {
+        const ssize_t written = write(fd, data, size_t(size));
+        if (written < 0) {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+        data += written;
+        size -= written;
+    }
+    return true;
+}
+
+} // namespace
+
+// --- 4. Implementation of SelectionPayload and SelectionWatcher ---
+
+SelectionPayload::~SelectionPayload()
+{
+    if (m_map)
+        munmap(m_map, size_t(m_size));
+    if (m_fd >= 0)
+        close(m_fd);
+}
+
+const char *SelectionPayload::data() const
+{
+    return m_map ? static_cast<const char *>(m_map) : m_bytes.constData();
+}
+
+SelectionWatcher::SelectionWatcher(Selections selections, const QStringList &imageFormats, QObject *parent)
+    : QObject(parent), d(std::make_unique<SelectionPrivate>()), m_selections(selections)
+{
+    qRegisterMetaType<SelectionPayloadPtr>();
+    qRegisterMetaType<SelectionWatcher::Selection>();
+    qRegisterMetaType<OriginalFormats::List>();
+    d->imageFormats = imageFormats;
+    d->ignored = &m_ignored;
+    setSizeLimits(qint64(16) << 20, qint64(64) << 20);
+}
+
+SelectionWatcher::~SelectionWatcher() = default;
+
+void SelectionWatcher::setSizeLimits(qint64 textBytes, qint64 imageBytes)
+{
+    d->textLimit = textBytes;
+    d->imageLimit = imageBytes;
+}
+
+void SelectionWatcher::ignoreNextChange(Selection selection)
+{
+    m_ignored.fetch_or(selection, std::memory_order_acq_rel);
+}
+
+void SelectionWatcher::run()
+{
+    if (!d->open(int(m_selections))) {
+        std::cerr << "Selection watching unavailable. Thread will now exit." << std::endl;
+        emit finished();
+        return;
+    }
+    emit watching();
+
+    pollfd fds[2];
+    fds[0].fd = ConnectionNumber(d->display);
+    fds[0].events = POLLIN;
+    fds[1].fd = d->wakeFd;
+    fds[1].events = POLLIN;
+
+    while (!m_stop.load(std::memory_order_acquire)) {
+        while (XPending(d->display)) {
+            XEvent ev;
+            XNextEvent(d->display, &ev);
+            SelectionPrivate::Result result;
+            if (d->handleEvent(ev, &result))
+                emit selectionCaptured(Selection(result.selection), result.format, result.payload, result.originals);
+        }
+
+        const qint64 now = Trace::now();
+        SelectionPrivate::Result result;
+        if (d->checkTimeout(now, &result))
+            emit selectionCaptured(Selection(result.selection), result.format, result.payload, result.originals);
+        d->startDueTransfers(now);
+        // A transfer request may have been queued above
+        XFlush(d->display);
+
+        const int ready = poll(fds, 2, d->pollTimeout(Trace::now()));
+        if (ready < 0) {
+            if (errno == EINTR)
+                continue;
+            std::cerr << "Error: poll() on the X connection failed." << std::endl;
+            break;
+        }
+        if (fds[0].revents & (POLLERR | POLLHUP)) {
+            std::cerr << "Error: Lost the X connection." << std::endl;
+            break;
+        }
+        if (fds[1].revents & POLLIN) {
+            uint64_t value;
+            while (read(d->wakeFd, &value, sizeof(value)) > 0) {}
+        }
+    }
+
+    emit finished();
+}
+
+void SelectionWatcher::stop()
+{
+    // Called from the GUI thread; the eventfd write wakes poll() in run().
+    m_stop.store(true, std::memory_order_release);
+    if (d->wakeFd >= 0) {
+        const uint64_t one = 1;
+        if (write(d->wakeFd, &one, sizeof(one)) < 0)
+            std::cerr << "Error: Cannot wake the selection thread." << std::endl;
+    }
+}
+
+
+// --- 5. Implementation of SelectionPrivate ---
+
+SelectionPrivate::Sink::~Sink()
+{
+    if (m_fd >= 0)
+        close(m_fd);
+}
+
+void SelectionPrivate::Sink::reset(qint64 limit)
+{
+    m_buffer.clear();
+    if (m_fd >= 0)
+        close(m_fd);
+    m_fd = -1;
+    m_size = 0;
+    m_limit = limit;
+    m_failed = false;
+}
+
+bool SelectionPrivate::Sink::append(const char *data, qsizetype size)
+{
+    if (m_failed)
+        return false;
+    m_size += size;
+    if (overLimit()) {
+        m_failed = true;
+        return false;
+    }
+
+    if (m_fd < 0 && m_size > SelectionWatcher::SpillThreshold) {
+        m_fd = memfd_create("linclip-selection", MFD_CLOEXEC);
+        if (m_fd < 0 || !writeAll(m_fd, m_buffer.constData(), m_buffer.size())) {
+            std::cerr << "Error: Cannot spill a selection transfer to a memfd." << std::endl;
+            m_failed = true;
+            return false;
+        }
+        m_buffer = QByteArray();
+    }
+
+    if (m_fd < 0) {
+        m_buffer.append(data, size);
+        return true;
+    }
+    if (!writeAll(m_fd, data, size)) {
+        m_failed = true;
+        return false;
+    }
+    return true;
+}
+
+std::shared_ptr<SelectionPayload> SelectionPrivate::Sink::finish()
+{
+    std::shared_ptr<SelectionPayload> payload;
+    if (!m_failed)
+        payload = SelectionPrivate::makePayload(m_buffer, m_fd, m_size);
+    else if (m_fd >= 0)
+        close(m_fd);
+    // The payload owns the fd now
+    m_fd = -1;
+    reset(m_limit);
+    return payload;
+}
+
+std::shared_ptr<SelectionPayload> SelectionPrivate::makePayload(const QByteArray &bytes, int fd, qsizetype size)
+{
+    std::shared_ptr<SelectionPayload> payload(new SelectionPayload);
+    payload->m_size = size;
+    if (fd < 0) {
+        payload->m_bytes = bytes;
+        return payload;
+    }
+
+    payload->m_fd = fd;
+    void *map = mmap(nullptr, size_t(size), PROT_READ, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED) {
+        std::cerr << "Error: Cannot map a selection transfer." << std::endl;
+        return nullptr; // Closes fd
+    }
+    payload->m_map = map;
+    return payload;
+}
+
+SelectionPrivate::SelectionPrivate()
+    : wakeFd(eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK))
+{
+    if (wakeFd < 0)
+        std::cerr << "Error: Cannot create the selection wake-up eventfd." << std::endl;
+}
+
+SelectionPrivate::~SelectionPrivate()
+{
+    if (display) {
+        if (window)
+            XDestroyWindow(display, window);
+        XCloseDisplay(display);
+    }
+    if (wakeFd >= 0)
+        close(wakeFd);
+}
+
+bool SelectionPrivate::open(int selections)
+{
+    if (wakeFd < 0)
+        return false;
+
+    display = XOpenDisplay(nullptr);
+    if (!display) {
+        std::cerr << "Error: Cannot open X display." << std::endl;
+        return false;
+    }
+
+    int errorBase = 0;
+    int major = 0;
+    int minor = 0;
+    if (!XFixesQueryExtension(display, &fixesEventBase, &errorBase)
+        || !XFixesQueryVersion(display, &major, &minor)) {
+        std::cerr << "Error: The X server has no XFixes extension." << std::endl;
+        return false;
+    }
+
+    // Never mapped: it only receives the transferred properties
+    window = XCreateSimpleWindow(display, DefaultRootWindow(display), -10, -10, 1, 1, 0, 0, 0);
+    XSelectInput(display, window, PropertyChangeMask);
+
+    QList<QByteArray> names = {
+        "CLIPBOARD", "TARGETS", "INCR", "UTF8_STRING", "text/plain;charset=utf-8", "text/uri-list",
+        "LINCLIP_SELECTION_0", "LINCLIP_SELECTION_1", "LINCLIP_SELECTION_2", "LINCLIP_SELECTION_3",
+    };
+    const int fixedCount = names.size();
+    for (const QString &format : imageFormats)
+        names.append(format.toLatin1());
+    for (const QString &format : OriginalFormats::kept())
+        names.append(format.toLatin1());
+    std::vector<char *> namePointers;
+    for (QByteArray &name : names)
+        namePointers.push_back(name.data());
+    std::vector<Atom> atoms(names.size());
+    XInternAtoms(display, namePointers.data(), int(namePointers.size()), False, atoms.data());
+
+    clipboardAtom = atoms[0];
+    targetsAtom = atoms[1];
+    incrAtom = atoms[2];
+    utf8Atom = atoms[3];
+    textPlainUtf8Atom = atoms[4];
+    uriListAtom = atoms[5];
+    std::copy(atoms.begin() + 6, atoms.begin() + fixedCount, propertyAtoms);
+    imageAtoms.assign(atoms.begin() + fixedCount, atoms.begin() + fixedCount + imageFormats.size());
+    originalAtoms.assign(atoms.begin() + fixedCount + imageFormats.size(), atoms.end());
+
+    for (int selection : { SelectionWatcher::Clipboard, SelectionWatcher::Primary }) {
+        if (selections & selection)
+            XFixesSelectSelectionInput(display, window, selectionAtom(selection), XFixesSetSelectionOwnerNotifyMask);
+    }
+    XFlush(display);
+    return true;
+}
+
+bool SelectionPrivate::handleEvent(const XEvent &event, Result *result)
+{
+    if (event.type == fixesEventBase + XFixesSelectionNotify) {
+        const auto &notify = reinterpret_cast<const XFixesSelectionNotifyEvent &>(event);
+        const int selection = selectionFor(notify.selection);
+        if (!selection || notify.owner == NoneValue)
+            return false;
+        // Our own paste taking the selection over: already in the history
+        if (ignored->fetch_and(~selection, std::memory_order_acq_rel) & selection)
+            return false;
+
+        // A newer owner makes a transfer from the old one pointless
+        if (transfer.stage != Transfer::Idle && transfer.selection == selection)
+            abortTransfer(nullptr);
+        // Restart the debounce: a burst of changes is transferred once
+        pendingUntil[slotOf(selection)] = Trace::now() + SelectionWatcher::DebounceMs * NsPerMs;
+        pendingTime[slotOf(selection)] = notify.selection_timestamp;
+        return false;
+    }
+
+    if (event.type == SelectionNotify) {
+        const XSelectionEvent &notify = event.xselection;
+        if (transfer.stage == Transfer::Idle || transfer.stage == Transfer::Incremental
+            || notify.requestor != window || notify.selection != selectionAtom(transfer.selection))
+            return false;
+
+        if (notify.property == NoneValue) {
+            // Refused. Clients without TARGETS still tend to have UTF-8 text,
+            // and very old ones only STRING.
+            if (transfer.stage == Transfer::Targets)
+                requestData(utf8Atom);
+            else if (!transfer.payload && transfer.target == utf8Atom)
+                requestData(XA_STRING);
+            else
+                return failTransfer(nullptr, result);
+            return false;
+        }
+
+        if (transfer.stage == Transfer::Targets) {
+            Atom type = NoneValue;
+            int format = 0;
+            unsigned long count = 0;
+            unsigned long after = 0;
+            unsigned char *data = nullptr;
+            Atom chosen = NoneValue;
+            if (XGetWindowProperty(display, window, transfer.property, 0, 4096, True, XA_ATOM,
+                                   &type, &format, &count, &after, &data) == SuccessValue
+                && type == XA_ATOM && format == 32) {
+                const Atom *targets = reinterpret_cast<const Atom *>(data);
+                chosen = chooseTarget(targets, count);
+                for (Atom original : originalAtoms) {
+                    if (original != chosen && std::find(targets, targets + count, original) != targets + count)
+                        transfer.originalTargets.push_back(original);
+                }
+            }
+            if (data)
+                XFree(data);
+            if (chosen == NoneValue)
+                abortTransfer(nullptr);
+            else
+                requestData(chosen);
+            return false;
+        }
+
+        unsigned long items = 0;
+        const Atom type = readProperty(&items);
+        if (type == incrAtom) {
+            // Reading deleted the property, which asks the owner for the
+            // first chunk; each comes as a PropertyNotify.
+            transfer.sink.reset(limitFor(transfer.target));
+            transfer.stage = Transfer::Incremental;
+            transfer.lastProgress = Trace::now();
+            return false;
+        }
+        if (type == NoneValue)
+            return failTransfer(transfer.sink.overLimit() ? "it is over the size limit" : "its data cannot be read", result);
+        return finishTransfer(result);
+    }
+
+    if (event.type == PropertyNotify) {
+        const XPropertyEvent &notify = event.xproperty;
+        if (transfer.stage != Transfer::Incremental || notify.window != window
+            || notify.atom != transfer.property || notify.state != PropertyNewValue)
+            return false;
+
+        unsigned long items = 0;
+        if (readProperty(&items) == NoneValue)
+            return failTransfer(transfer.sink.overLimit() ? "it is over the size limit" : "its data cannot be read", result);
+        transfer.lastProgress = Trace::now();
+        // A zero-length chunk ends the transfer
+        if (items == 0)
+            return finishTransfer(result);
+    }
+    return false;
+}
+
+void SelectionPrivate::startDueTransfers(qint64 now)
+{
+    if (transfer.stage != Transfer::Idle)
+        return;
+    for (int selection : { SelectionWatcher::Clipboard, SelectionWatcher::Primary }) {
+        const int slot = slotOf(selection);
+        if (!pendingUntil[slot] || now < pendingUntil[slot])
+            continue;
+        pendingUntil[slot] = 0;
+
+        transfer.stage = Transfer::Targets;
+        transfer.selection = selection;
+        transfer.property = propertyAtoms[transferCount++ % 4];
+        transfer.target = targetsAtom;
+        transfer.time = pendingTime[slot];
+        transfer.started = now;
+        transfer.lastProgress = now;
+        XConvertSelection(display, selectionAtom(selection), targetsAtom, transfer.property, window, transfer.time);
+        return;
+    }
+}
+
+bool SelectionPrivate::checkTimeout(qint64 now, Result *result)
+{
+    if (transfer.stage != Transfer::Idle
+        && now - transfer.lastProgress > SelectionWatcher::TransferTimeoutMs * NsPerMs) {
+        // Nor is it asked for the rest of the original formats
+        transfer.originalTargets.clear();
+        return failTransfer("the owner stopped responding", result);
+    }
+    return false;
+}
+
+int SelectionPrivate::pollTimeout(qint64 now) const
+{
+    qint64 deadline = 0;
+    if (transfer.stage != Transfer::Idle)
+        deadline = transfer.lastProgress + SelectionWatcher::TransferTimeoutMs * NsPerMs;
+    for (qint64 until : pendingUntil) {
+        if (until && (!deadline || until < deadline))
+            deadline = until;
+    }
+    if (!deadline)
+        return -1;
+    // Rounded up, so the deadline has passed when poll() returns
+    return int(std::max<qint64>(0, (deadline - now + NsPerMs - 1) / NsPerMs));
+}
+
+Atom SelectionPrivate::selectionAtom(int selection) const
+{
+    return selection == SelectionWatcher::Primary ? XA_PRIMARY : clipboardAtom;
+}
+
+int SelectionPrivate::selectionFor(Atom atom) const
+{
+    if (atom == clipboardAtom)
+        return SelectionWatcher::Clipboard;
+    if (atom == XA_PRIMARY)
+        return SelectionWatcher::Primary;
+    return 0;
+}
+
+Atom SelectionPrivate::chooseTarget(const Atom *targets, unsigned long count) const
+{
+    auto offered = [targets, count](Atom target) {
+        return std::find(targets, targets + count, target) != targets + count;
+    };
+    // Same order as ClipboardCapture: image, file, text
+    for (Atom image : imageAtoms) {
+        if (offered(image))
+            return image;
+    }
+    for (Atom target : { uriListAtom, utf8Atom, textPlainUtf8Atom, Atom(XA_STRING) }) {
+        if (offered(target))
+            return target;
+    }
+    return NoneValue;
+}
+
+QString SelectionPrivate::formatFor(Atom target) const
+{
+    const auto image = std::find(imageAtoms.begin(), imageAtoms.end(), target);
+    if (image != imageAtoms.end())
+        return imageFormats.at(int(image - imageAtoms.begin()));
+    if (target == uriListAtom)
+        return QStringLiteral("text/uri-list");
+    if (target == XA_STRING)
+        return QStringLiteral("text/plain;charset=iso-8859-1");
+    return QStringLiteral("text/plain;charset=utf-8");
+}
+
+qint64 SelectionPrivate::limitFor(Atom target) const
+{
+    if (isOriginal(target))
+        return OriginalFormats::SizeLimit - transfer.originalBytes;
+    return std::find(imageAtoms.begin(), imageAtoms.end(), target) != imageAtoms.end() ? imageLimit : textLimit;
+}
+
+bool SelectionPrivate::isOriginal(Atom target) const
+{
+    // The chosen target may be one of them too (text/uri-list)
+    return transfer.payload && std::find(originalAtoms.begin(), originalAtoms.end(), target) != originalAtoms.end();
+}
+
+void SelectionPrivate::requestData(Atom target)
+{
+    transfer.stage = Transfer::Data;
+    transfer.target = target;
+    transfer.lastProgress = Trace::now();
+    transfer.sink.reset(limitFor(target));
+    XConvertSelection(display, selectionAtom(transfer.selection), target, transfer.property, window, transfer.time);
+}
+
+Atom SelectionPrivate::readProperty(unsigned long *itemCount)
+{
+    *itemCount = 0;
+    Atom type = NoneValue;
+    long offset = 0;
+    unsigned long after = 0;
+    do {
+        int format = 0;
+        unsigned long count = 0;
+        unsigned char *data = nullptr;
+        // Deletes the property once the last piece has been read
+        if (XGetWindowProperty(display, window, transfer.property, offset, ReadChunkLongs, True,
+                               AnyPropertyType, &type, &format, &count, &after, &data) != SuccessValue
+            || type == NoneValue) {
+            if (data)
+                XFree(data);
+            return NoneValue;
+        }
+
+        // Xlib hands 32-bit items over as longs
+        const qsizetype itemSize = format == 32 ? qsizetype(sizeof(long)) : format / 8;
+        const bool appended = type == incrAtom
+            || transfer.sink.append(reinterpret_cast<const char *>(data), qsizetype(count) * itemSize);
+        XFree(data);
+        if (!appended)
+            return NoneValue;
+
+        *itemCount += count;
+        offset += long(count * unsigned(format) / 32);
+    } while (after > 0);
+    return type;
+}
+
+bool SelectionPrivate::finishTransfer(Result *result)
+{
+    std::shared_ptr<SelectionPayload> payload = transfer.sink.finish();
+    if (!transfer.payload) {
+        if (!payload || payload->size() == 0) {
+            abortTransfer(nullptr);
+            return false;
+        }
+        transfer.payload = std::move(payload);
+        transfer.format = formatFor(transfer.target);
+    } else if (payload && payload->size() > 0) {
+        const auto original = std::find(originalAtoms.begin(), originalAtoms.end(), transfer.target);
+        transfer.originals.append({ OriginalFormats::kept().at(int(original - originalAtoms.begin())),
+                                    QByteArray(payload->data(), payload->size()) });
+        transfer.originalBytes += payload->size();
+    }
+    return nextOriginal(result);
+}
+
+bool SelectionPrivate::nextOriginal(Result *result)
+{
+    if (!transfer.originalTargets.empty() && transfer.originalBytes < OriginalFormats::SizeLimit) {
+        const Atom target = transfer.originalTargets.front();
+        transfer.originalTargets.erase(transfer.originalTargets.begin());
+        requestData(target);
+        return false;
+    }
+
+    result->selection = transfer.selection;
+    result->format = transfer.format;
+    result->payload = std::move(transfer.payload);
+    result->originals = std::move(transfer.originals);
+    Trace::record(Trace::CaptureFetch, transfer.started, Trace::now(), result->payload->size());
+    abortTransfer(nullptr);
+    return true;
+}
+
+bool SelectionPrivate::failTransfer(const char *reason, Result *result)
+{
+    if (!transfer.payload) {
+        abortTransfer(reason);
+        return false;
+    }
+    // Only this original format is left out. Chunks of an abandoned INCR
+    // transfer may still arrive on its property, so the next format is
+    // requested on another one.
+    transfer.sink.reset(0);
+    transfer.property = propertyAtoms[transferCount++ % 4];
+    return nextOriginal(result);
+}
+
+void SelectionPrivate::abortTransfer(const char *reason)
+{
+    if (reason) {
+        std::cerr << "Warning: Abandoning a selection transfer because " << reason << "." << std::endl;
+    }
+    transfer.sink.reset(0);
+    transfer.stage = Transfer::Idle;
+    transfer.payload.reset();
+    transfer.format.clear();
+    transfer.originalTargets.clear();
+    transfer.originals.clear();
+    transfer.originalBytes = 0;
+}
@@ -0,0 +1,104 @@
+#pragma once
+
+#include "originalformats.h"
+
+#include <QByteArray>
+#include <QMetaType>
+#include <QObject>
+#include <QString>
+#include <QStringList>
+#include <atomic>
+#include <memory>
+
+// PIMPL, as in GlobalHotkeyManager: no X11 headers outside the .cpp
+class SelectionPrivate;
+
+// The bytes of one finished selection transfer. Small transfers stay in
+// memory; larger ones were streamed into an anonymous file (memfd) and are
+// mapped read-only, so a big INCR transfer never sits on the heap while it
+// comes in. Decoding it does put it there (see
+// ClipboardCapture::captureSelection()).
+class SelectionPayload
+{
+public:
+    ~SelectionPayload();
+
+    const char *data() const;
+    qsizetype size() const { return m_size; }
+    // The memfd holding the data, or -1 if it is in memory
+    int fd() const { return m_fd; }
+
+private:
+    friend class SelectionPrivate;
+    SelectionPayload() = default;
+    Q_DISABLE_COPY(SelectionPayload)
+
+    QByteArray m_bytes;
+    int m_fd = -1;
+    void *m_map = nullptr;
+    qsizetype m_size = 0;
+};
+
+using SelectionPayloadPtr = std::shared_ptr<const SelectionPayload>;
+Q_DECLARE_METATYPE(SelectionPayloadPtr)
+
+// Watches the X selections without Qt's clipboard.
+//
+// Runs on its own thread and X connection, like the hotkey manager: owner
+// changes are reported by XFixes, bursts are coalesced, and the data is
+// requested asynchronously. TARGETS decides the format (an image the
+// decoder knows, a file list or UTF-8 text, in that order), and INCR
+// transfers are streamed chunk by chunk into the payload. The original
+// formats offered along with it are fetched next.
+class SelectionWatcher : public QObject
+{
+    Q_OBJECT
+
+public:
+    enum Selection {
+        Clipboard = 0x1,
+        Primary = 0x2
+    };
+    Q_DECLARE_FLAGS(Selections, Selection)
+
+    static constexpr int DebounceMs = 50;
+    // A transfer that makes no progress for this long is abandoned
+    static constexpr int TransferTimeoutMs = 3000;
+    // Transfers beyond this go to an anonymous file instead of the heap
+    static constexpr qsizetype SpillThreshold = 1024 * 1024;
+
+    // imageFormats: the image MIME types the decoder can read, preferred first
+    SelectionWatcher(Selections selections, const QStringList &imageFormats, QObject *parent = nullptr);
+    ~SelectionWatcher();
+
+    // Transfers over these sizes are abandoned. Call before run().
+    void setSizeLimits(qint64 textBytes, qint64 imageBytes);
+
+    // Thread-safe: the next owner change of selection is ours (an entry
+    // being pasted) and is not transferred back
+    void ignoreNextChange(Selection selection);
+
+public slots:
+    void run();
+    // Thread-safe: wakes the blocking loop in run(). Connect it with
+    // Qt::DirectConnection, the watcher thread never returns to its event loop.
+    void stop();
+
+signals:
+    // Emitted once the selections are being watched; not at all if the
+    // X server or XFixes is unavailable
+    void watching();
+    // From the watcher thread. format is a MIME type: image/..., text/uri-list
+    // or text/plain;charset=utf-8 (or iso-8859-1)
+    void selectionCaptured(SelectionWatcher::Selection selection, const QString &format,
+                           const SelectionPayloadPtr &payload, const OriginalFormats::List &originals);
+    void finished();
+
+private:
+    std::unique_ptr<SelectionPrivate> d;
+    Selections m_selections;
+    std::atomic<bool> m_stop { false };
+    std::atomic<int> m_ignored { 0 };
+};
+
+Q_DECLARE_OPERATORS_FOR_FLAGS(SelectionWatcher::Selections)
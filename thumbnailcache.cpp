@@ -0,0 +1,63 @@
+#include "thumbnailcache.h"
+
+#include <QIcon>
+#include <QPainter>
+#include <QThread>
+
+namespace {
+// Thumbnails are at most 64x64 ARGB (16 KiB); this keeps a few thousand
+constexpr qsizetype CacheBudgetBytes = 32 * 1024 * 1024;
+}
+
+ThumbnailCache::ThumbnailCache(QObject *parent)
+    : QObject(parent)
+    , m_pixmaps(CacheBudgetBytes)
+{
+    // Scaling is memory bound; two workers are plenty and keep cores free
+    m_pool.setMaxThreadCount(qBound(1, QThread::idealThreadCount() / 2, 2));
+
+    m_placeholder = QIcon::fromTheme("image-x-generic").pixmap(ThumbnailSize, ThumbnailSize);
+    if (m_placeholder.isNull()) {
+        m_placeholder = QPixmap(ThumbnailSize, ThumbnailSize);
+        m_placeholder.fill(Qt::transparent);
+        QPainter painter(&m_placeholder);
+        painter.setPen(Qt::NoPen);
+        painter.setBrush(QColor(128, 128, 128, 96));
+        painter.drawRoundedRect(m_placeholder.rect().adjusted(4, 4, -4, -4), 6, 6);
+    }
+}
+
+ThumbnailCache::~ThumbnailCache()
+{
+    // Results still in flight are posted to this object and dropped with it
+    m_pool.clear();
+    m_pool.waitForDone();
+}
+
+QPixmap ThumbnailCache::thumbnail(quint64 key, const std::function<QImage()> &load)
+{
+    if (const QPixmap *cached = m_pixmaps.object(key))
+        return *cached;
+
+    if (!m_pending.contains(key)) {
+        m_pending.insert(key);
+        m_pool.start([this, key, load]() {
+            const QImage scaled = load().scaled(ThumbnailSize, ThumbnailSize,
+                                               Qt::KeepAspectRatio, Qt::SmoothTransformation);
+            QMetaObject::invokeMethod(this, [this, key, scaled]() {
+                onThumbnailScaled(key, scaled);
+            }, Qt::QueuedConnection);
+        });
+    }
+    return m_placeholder;
+}
+
+void ThumbnailCache::onThumbnailScaled(quint64 key, const QImage &thumbnail)
+{
+    m_pending.remove(key);
+    // QPixmap must be created on the GUI thread; for 64x64 this is cheap
+    // A failed load keeps the placeholder rather than retrying on every paint
+    auto *pixmap = new QPixmap(thumbnail.isNull() ? m_placeholder : QPixmap::fromImage(thumbnail));
+    m_pixmaps.insert(key, pixmap, qMax<qsizetype>(1, thumbnail.sizeInBytes()));
+    emit thumbnailReady(key);
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <QCache>
+#include <QImage>
+#include <QObject>
+#include <QPixmap>
+#include <QSet>
+#include <QThreadPool>
+
+#include <functional>
+
+// Produces list thumbnails for image clips on a worker pool and keeps
+// them in a cache keyed by the image's ContentHash fingerprint. The GUI thread never
+// resamples a full-size image; until a thumbnail is ready it gets a
+// placeholder and thumbnailReady() tells it when to repaint.
+class ThumbnailCache : public QObject
+{
+    Q_OBJECT
+
+public:
+    static constexpr int ThumbnailSize = 64;
+
+    explicit ThumbnailCache(QObject *parent = nullptr);
+    ~ThumbnailCache();
+
+    // Returns the cached thumbnail, or the placeholder after scheduling
+    // a worker to load the full image and scale it. load() runs on the
+    // worker thread and must be thread-safe.
+    QPixmap thumbnail(quint64 key, const std::function<QImage()> &load);
+    QPixmap placeholder() const { return m_placeholder; }
+
+signals:
+    void thumbnailReady(quint64 key);
+
+private:
+    void onThumbnailScaled(quint64 key, const QImage &thumbnail);
+
+    QThreadPool m_pool;
+    QCache<quint64, QPixmap> m_pixmaps;
+    QSet<quint64> m_pending;
+    QPixmap m_placeholder;
+};
@@ -0,0 +1,490 @@
+#include "tilepool.h"
+#include "contenthash.h"
+#include "historylog.h"
+#include "imagecodec.h"
+
+#include <QPair>
+#include <QSet>
+
+#include <cstring>
+#include <utility>
+
+namespace {
+
+// Tile map: MapHeader, then a ContentHash per tile, row by row
+struct MapHeader {
+    quint32 magic;
+    qint32 format;
+    quint32 width;
+    quint32 height;
+    quint32 tileSize;
+    quint32 reserved;
+};
+
+// Tiles record: a count, that many DirectoryEntry, then the tiles
+struct DirectoryEntry {
+    quint64 hash;
+    quint32 offset; // From the start of the payload
+    quint32 size;
+};
+
+constexpr quint32 MapMagic = 0x314c4954; // "TIL1"
+constexpr quint64 TileSeed = 0x54494c4500000003ULL;
+
+struct Grid {
+    int columns;
+    int rows;
+    int count() const { return columns * rows; }
+};
+
+Grid gridFor(int width, int height)
+{
+    return { (width + TilePool::TileSize - 1) / TilePool::TileSize,
+             (height + TilePool::TileSize - 1) / TilePool::TileSize };
+}
+
+QRect tileRect(const Grid &grid, int index, int width, int height)
+{
+    const int x = (index % grid.columns) * TilePool::TileSize;
+    const int y = (index / grid.columns) * TilePool::TileSize;
+    return QRect(x, y, qMin(TilePool::TileSize, width - x), qMin(TilePool::TileSize, height - y));
+}
+
+// The tile's size and the bytes of its rows. Row by row, each one 256
+// bytes at most, through the four-lane XXH64 of ContentHash.
+quint64 hashTile(const QImage &image, const QRect &rect)
+{
+    const int size[2] = { rect.width(), rect.height() };
+    quint64 h = ContentHash::hash(size, sizeof(size), TileSeed);
+    const size_t rowBytes = size_t(rect.width()) * 4;
+    for (int y = rect.top(); y <= rect.bottom(); ++y)
+        h = ContentHash::hash(image.constScanLine(y) + rect.left() * 4, rowBytes, h);
+    return h;
+}
+
+// Header and hashes of a map, or false if it is not a well-formed one
+bool parseMap(const char *data, qsizetype size, MapHeader *header, const char **hashes)
+{
+    if (!data || size < qsizetype(sizeof(MapHeader)))
+        return false;
+    std::memcpy(header, data, sizeof(MapHeader));
+    if (header->magic != MapMagic || header->tileSize != quint32(TilePool::TileSize)
+        || header->width == 0 || header->height == 0 || header->width > 65535 || header->height > 65535)
+        return false;
+    const Grid grid = gridFor(int(header->width), int(header->height));
+    if (size != qsizetype(sizeof(MapHeader)) + qsizetype(grid.count()) * qsizetype(sizeof(quint64)))
+        return false;
+    *hashes = data + sizeof(MapHeader);
+    return true;
+}
+
+inline quint64 hashAt(const char *hashes, int index)
+{
+    quint64 hash;
+    std::memcpy(&hash, hashes + qsizetype(index) * qsizetype(sizeof(quint64)), sizeof(hash));
+    return hash;
+}
+
+// Decodes a tile into its place in image
+bool blit(QImage *image, const QRect &rect, const char *data, qsizetype size)
+{
+    const QImage tile = ImageCodec::decompress(data, size);
+    if (tile.width() != rect.width() || tile.height() != rect.height() || tile.depth() != 32)
+        return false;
+    const size_t rowBytes = size_t(rect.width()) * 4;
+    for (int y = 0; y < rect.height(); ++y)
+        std::memcpy(image->scanLine(rect.top() + y) + rect.left() * 4, tile.constScanLine(y), rowBytes);
+    return true;
+}
+
+} // namespace
+
+TilePool::TilePool(HistoryLog *log)
+    : m_log(log)
+{
+}
+
+bool TilePool::isTileMap(const char *data, qsizetype size)
+{
+    quint32 magic = 0;
+    if (data && size >= qsizetype(sizeof(MapHeader)))
+        std::memcpy(&magic, data, sizeof(magic));
+    return magic == MapMagic;
+}
+
+TilePool::Split TilePool::split(const QImage &source) const
+{
+    Split result;
+    const QImage image = ImageCodec::storable(source);
+    if (image.isNull() || image.width() > 65535 || image.height() > 65535)
+        return result;
+
+    const Grid grid = gridFor(image.width(), image.height());
+    result.map.resize(qsizetype(sizeof(MapHeader)) + qsizetype(grid.count()) * qsizetype(sizeof(quint64)));
+    const MapHeader header = { MapMagic, qint32(image.format()), quint32(image.width()), quint32(image.height()),
+                               quint32(TileSize), 0 };
+    std::memcpy(result.map.data(), &header, sizeof(header));
+
+    QList<quint64> hashes(grid.count());
+    for (int i = 0; i < grid.count(); ++i)
+        hashes[i] = hashTile(image, tileRect(grid, i, image.width(), image.height()));
+    std::memcpy(result.map.data() + sizeof(header), hashes.constData(), size_t(hashes.size()) * sizeof(quint64));
+
+    // Only tiles the pool does not have yet are compressed
+    QList<int> missing;
+    {
+        QMutexLocker locker(&m_mutex);
+        for (int i = 0; i < grid.count(); ++i) {
+            const auto it = m_tiles.constFind(hashes.at(i));
+            if (it != m_tiles.cend())
+                result.compressedBytes += it->size;
+            else
+                missing.append(i);
+        }
+    }
+    for (int i : missing) {
+        const quint64 hash = hashes.at(i);
+        auto it = result.newTiles.constFind(hash);
+        if (it == result.newTiles.cend())
+            it = result.newTiles.insert(hash, ImageCodec::compress(image.copy(tileRect(grid, i, image.width(), image.height()))));
+        result.compressedBytes += it->size();
+    }
+    return result;
+}
+
+bool TilePool::add(const Split &split, const QImage &image)
+{
+    MapHeader header;
+    const char *hashes;
+    if (!parseMap(split.map.constData(), split.map.size(), &header, &hashes))
+        return false;
+    const Grid grid = gridFor(int(header.width), int(header.height));
+
+    QList<quint64> unpersisted;
+    {
+        QMutexLocker locker(&m_mutex);
+        QImage storable;
+        QSet<quint64> seen;
+        for (int i = 0; i < grid.count(); ++i) {
+            const quint64 hash = hashAt(hashes, i);
+            auto it = m_tiles.find(hash);
+            if (it == m_tiles.end()) {
+                Tile tile;
+                tile.data = split.newTiles.value(hash);
+                if (tile.data.isEmpty()) {
+                    // The pool had it when split() ran, but not any more
+                    if (storable.isNull())
+                        storable = ImageCodec::storable(image);
+                    tile.data = ImageCodec::compress(storable.copy(tileRect(grid, i, storable.width(), storable.height())));
+                }
+                tile.size = quint32(tile.data.size());
+                m_storedBytes += tile.size;
+                it = m_tiles.insert(hash, tile);
+            }
+            ++it->refs;
+            m_referencedBytes += it->size;
+            // Including tiles an earlier image could only keep in memory
+            if (it->recordId == 0 && m_log->isOpen() && !seen.contains(hash)) {
+                seen.insert(hash);
+                unpersisted.append(hash);
+            }
+        }
+    }
+    return unpersisted.isEmpty() || persist(unpersisted);
+}
+
+bool TilePool::persist(const QList<quint64> &hashes)
+{
+    const qsizetype directorySize = qsizetype(sizeof(quint32)) + hashes.size() * qsizetype(sizeof(DirectoryEntry));
+    QByteArray payload(directorySize, Qt::Uninitialized);
+    QList<DirectoryEntry> directory;
+    {
+        QMutexLocker locker(&m_mutex);
+        for (quint64 hash : hashes) {
+            const auto it = m_tiles.constFind(hash);
+            directory.append({ hash, quint32(payload.size()), quint32(it->data.size()) });
+            payload += it->data;
+        }
+    }
+    const quint32 count = quint32(directory.size());
+    std::memcpy(payload.data(), &count, sizeof(count));
+    std::memcpy(payload.data() + sizeof(count), directory.constData(), size_t(directory.size()) * sizeof(DirectoryEntry));
+
+    // Without the pool locked: readers may go on while the record is synced
+    const quint64 recordId = m_log->append(HistoryLog::Tiles, payload, 0, QString());
+    if (recordId == 0)
+        return false;
+
+    QMutexLocker locker(&m_mutex);
+    for (const DirectoryEntry &entry : std::as_const(directory)) {
+        Tile &tile = m_tiles[entry.hash];
+        tile.recordId = recordId;
+        tile.offset = entry.offset;
+        tile.data = QByteArray(); // Read back from the record from now on
+    }
+    m_liveTilesByRecord.insert(recordId, int(directory.size()));
+    return true;
+}
+
+void TilePool::release(const QByteArray &map)
+{
+    MapHeader header;
+    const char *hashes;
+    if (!parseMap(map.constData(), map.size(), &header, &hashes))
+        return;
+    const Grid grid = gridFor(int(header.width), int(header.height));
+
+    QList<quint64> unused;
+    {
+        QMutexLocker locker(&m_mutex);
+        if (m_stage != Restored) {
+            // Tiles are only dropped once every map is counted. A map not
+            // counted yet is skipped instead.
+            const quint64 mapHash = ContentHash::hash(map.constData(), size_t(map.size()));
+            if (m_countedMaps.contains(mapHash))
+                m_deferredReleases.append(QByteArray(map.constData(), map.size()));
+            else
+                m_skippedMaps.insert(mapHash);
+            return;
+        }
+        for (int i = 0; i < grid.count(); ++i) {
+            const quint64 recordId = unref(hashAt(hashes, i));
+            if (recordId != 0)
+                unused.append(recordId);
+        }
+    }
+    for (quint64 recordId : std::as_const(unused))
+        m_log->remove(recordId);
+}
+
+quint64 TilePool::unref(quint64 hash)
+{
+    const auto it = m_tiles.find(hash);
+    if (it == m_tiles.end())
+        return 0;
+    m_referencedBytes -= it->size;
+    if (--it->refs > 0)
+        return 0;
+
+    const quint64 recordId = it->recordId;
+    m_storedBytes -= it->size;
+    m_tiles.erase(it);
+    if (recordId == 0 || --m_liveTilesByRecord[recordId] > 0)
+        return 0;
+    m_liveTilesByRecord.remove(recordId);
+    return recordId;
+}
+
+QImage TilePool::assemble(const char *map, qsizetype size) const
+{
+    MapHeader header;
+    const char *hashes;
+    if (!parseMap(map, size, &header, &hashes))
+        return QImage();
+    const int width = int(header.width);
+    const int height = int(header.height);
+    const Grid grid = gridFor(width, height);
+
+    struct Part {
+        int index;
+        quint32 offset;
+        quint32 size;
+    };
+    QList<QPair<int, QByteArray>> inMemory;
+    QHash<quint64, QList<Part>> byRecord;
+    {
+        QMutexLocker locker(&m_mutex);
+        while (m_stage == Locating)
+            m_located.wait(&m_mutex);
+        for (int i = 0; i < grid.count(); ++i) {
+            const auto it = m_tiles.constFind(hashAt(hashes, i));
+            if (it == m_tiles.cend())
+                return QImage();
+            if (it->recordId != 0)
+                byRecord[it->recordId].append({ i, it->offset, it->size });
+            else
+                inMemory.append({ i, it->data });
+        }
+    }
+
+    QImage image(width, height, QImage::Format(header.format));
+    if (image.isNull() || image.depth() != 32)
+        return QImage();
+    for (const auto &tile : std::as_const(inMemory)) {
+        if (!blit(&image, tileRect(grid, tile.first, width, height), tile.second.constData(), tile.second.size()))
+            return QImage();
+    }
+    // One read per record: the tiles of a burst mostly come from a few
+    for (auto it = byRecord.cbegin(); it != byRecord.cend(); ++it) {
+        bool ok = true;
+        const bool read = m_log->readPayload(it.key(), [&](const char *data, qsizetype payloadSize) {
+            for (const Part &part : it.value()) {
+                ok = ok && qint64(part.offset) + part.size <= payloadSize
+                    && blit(&image, tileRect(grid, part.index, width, height), data + part.offset, part.size);
+            }
+        });
+        if (!read || !ok)
+            return QImage();
+    }
+    return image;
+}
+
+void TilePool::beginRestore()
+{
+    clear();
+    QMutexLocker locker(&m_mutex);
+    m_stage = Locating;
+}
+
+void TilePool::restore(const QList<HistoryLog::Record> &tileRecords, const QList<HistoryLog::Record> &imageRecords)
+{
+    quint64 generation;
+    {
+        QMutexLocker locker(&m_mutex);
+        generation = m_generation;
+    }
+
+    for (const HistoryLog::Record &record : tileRecords) {
+        quint32 count = 0;
+        m_log->readPayloadPrefix(record.id, sizeof(count), [&](const char *data, qsizetype size) {
+            if (size >= qsizetype(sizeof(count)))
+                std::memcpy(&count, data, sizeof(count));
+        });
+        const qsizetype directorySize = qsizetype(sizeof(count)) + qsizetype(count) * qsizetype(sizeof(DirectoryEntry));
+        if (count == 0 || quint64(directorySize) > record.payloadLength)
+            continue;
+        m_log->readPayloadPrefix(record.id, directorySize, [&](const char *data, qsizetype size) {
+            if (size < directorySize)
+                return;
+            QMutexLocker locker(&m_mutex);
+            if (m_generation != generation)
+                return;
+            for (quint32 i = 0; i < count; ++i) {
+                DirectoryEntry entry;
+                std::memcpy(&entry, data + sizeof(count) + i * sizeof(DirectoryEntry), sizeof(entry));
+                if (quint64(entry.offset) + entry.size > record.payloadLength || m_tiles.contains(entry.hash))
+                    continue;
+                Tile tile;
+                tile.recordId = record.id;
+                tile.offset = entry.offset;
+                tile.size = entry.size;
+                m_tiles.insert(entry.hash, tile);
+                m_storedBytes += tile.size;
+                ++m_liveTilesByRecord[record.id];
+            }
+        });
+    }
+    {
+        QMutexLocker locker(&m_mutex);
+        if (m_generation != generation)
+            return;
+        m_stage = Counting;
+        m_located.wakeAll();
+    }
+
+    // A map is its whole record; plain ImageCodec images only have their
+    // first bytes read
+    for (const HistoryLog::Record &record : imageRecords) {
+        bool tiled = false;
+        m_log->readPayloadPrefix(record.id, sizeof(MapHeader), [&](const char *data, qsizetype size) {
+            tiled = isTileMap(data, size);
+        });
+        if (!tiled)
+            continue;
+        m_log->readPayloadPrefix(record.id, qsizetype(record.payloadLength), [&](const char *data, qsizetype size) {
+            const quint64 mapHash = ContentHash::hash(data, size_t(size));
+            QMutexLocker locker(&m_mutex);
+            if (m_generation != generation || m_skippedMaps.contains(mapHash))
+                return;
+            retain(QByteArray::fromRawData(data, size));
+            m_countedMaps.insert(mapHash);
+        });
+    }
+
+    // Tiles left over from images removed before a crash, or meanwhile
+    QList<quint64> unused;
+    {
+        QMutexLocker locker(&m_mutex);
+        if (m_generation != generation)
+            return;
+        m_stage = Restored;
+        m_countedMaps.clear();
+        m_skippedMaps.clear();
+        const QList<QByteArray> deferred = std::exchange(m_deferredReleases, {});
+        for (const QByteArray &map : deferred) {
+            MapHeader header;
+            const char *hashes;
+            if (!parseMap(map.constData(), map.size(), &header, &hashes))
+                continue;
+            // The tiles left unused are dropped with the others below
+            const Grid grid = gridFor(int(header.width), int(header.height));
+            for (int i = 0; i < grid.count(); ++i) {
+                const auto it = m_tiles.find(hashAt(hashes, i));
+                if (it != m_tiles.end() && it->refs > 0) {
+                    --it->refs;
+                    m_referencedBytes -= it->size;
+                }
+            }
+        }
+        for (auto it = m_tiles.begin(); it != m_tiles.end();) {
+            if (it->refs > 0) {
+                ++it;
+                continue;
+            }
+            m_storedBytes -= it->size;
+            --m_liveTilesByRecord[it->recordId];
+            it = m_tiles.erase(it);
+        }
+        for (const HistoryLog::Record &record : tileRecords) {
+            if (m_liveTilesByRecord.value(record.id) <= 0) {
+                m_liveTilesByRecord.remove(record.id);
+                unused.append(record.id);
+            }
+        }
+    }
+    for (quint64 recordId : std::as_const(unused))
+        m_log->remove(recordId);
+}
+
+void TilePool::retain(const QByteArray &map)
+{
+    MapHeader header;
+    const char *hashes;
+    if (!parseMap(map.constData(), map.size(), &header, &hashes))
+        return;
+    const Grid grid = gridFor(int(header.width), int(header.height));
+
+    for (int i = 0; i < grid.count(); ++i) {
+        const auto it = m_tiles.find(hashAt(hashes, i));
+        // A missing tile leaves the image undecodable, not the pool
+        if (it != m_tiles.end()) {
+            ++it->refs;
+            m_referencedBytes += it->size;
+        }
+    }
+}
+
+void TilePool::clear()
+{
+    QMutexLocker locker(&m_mutex);
+    ++m_generation;
+    m_stage = Restored;
+    m_countedMaps.clear();
+    m_skippedMaps.clear();
+    m_deferredReleases.clear();
+    m_located.wakeAll();
+    m_tiles.clear();
+    m_liveTilesByRecord.clear();
+    m_storedBytes = 0;
+    m_referencedBytes = 0;
+}
+
+TilePool::Stats TilePool::stats() const
+{
+    QMutexLocker locker(&m_mutex);
+    Stats stats;
+    stats.tiles = int(m_tiles.size());
+    stats.storedBytes = m_storedBytes;
+    stats.referencedBytes = m_referencedBytes;
+    return stats;
+}
@@ -0,0 +1,113 @@
+#pragma once
+
+#include "historylog.h"
+
+#include <QByteArray>
+#include <QHash>
+#include <QImage>
+#include <QList>
+#include <QMutex>
+#include <QSet>
+#include <QWaitCondition>
+
+// Content-addressed, refcounted store of image tiles. Screenshots taken in
+// a burst mostly differ in a small region, so images are kept as a map of
+// TileSize x TileSize tiles and every distinct tile is stored (compressed
+// with ImageCodec) once, however many images use it.
+//
+// A tile is addressed by its ContentHash of the pixel bytes. Tiles are
+// held in memory, or with a HistoryLog open, in Tiles records: each image
+// writes the tiles it adds as one record, so a capture costs one sync.
+// Records are removed once none of their tiles is used any more.
+//
+// split() and assemble() may be called from any thread; add(), release(),
+// beginRestore() and clear() are for the thread that owns the log, and
+// restore() runs on a worker.
+class TilePool
+{
+public:
+    static constexpr int TileSize = 64;
+
+    // What a worker prepares for add(): the image's tile map and the
+    // compressed tiles that were not in the pool yet
+    struct Split {
+        QByteArray map;
+        QHash<quint64, QByteArray> newTiles;
+        qint64 compressedBytes = 0; // All tiles, as if stored on their own
+    };
+
+    struct Stats {
+        int tiles = 0;
+        qint64 storedBytes = 0;     // Distinct tiles, compressed
+        qint64 referencedBytes = 0; // What the images would take unshared
+    };
+
+    explicit TilePool(HistoryLog *log);
+
+    // An image's tile map, rather than a plain ImageCodec stream
+    static bool isTileMap(const char *data, qsizetype size);
+    static bool isTileMap(const QByteArray &data) { return isTileMap(data.constData(), data.size()); }
+
+    Split split(const QImage &image) const;
+    // References the tiles of split.map, storing the new ones. image is
+    // the one split, for tiles released meanwhile. Returns false if the
+    // tiles could only be kept in memory although the log is open.
+    bool add(const Split &split, const QImage &image);
+    void release(const QByteArray &map);
+    // A null image if a tile is missing or damaged
+    QImage assemble(const char *map, qsizetype size) const;
+    QImage assemble(const QByteArray &map) const { return assemble(map.constData(), map.size()); }
+
+    // Empties the pool for a restore() queued on a worker, so that opening
+    // the log does not wait for it. Until the tiles are located, assemble()
+    // waits; until they are counted, release() is deferred.
+    void beginRestore();
+    // Rebuilds the pool from the log's Tiles records and the maps of its
+    // images, then drops records no image refers to. Only the directories
+    // and maps are read, without checksumming the tiles: they are checked
+    // when an image is assembled. Stops if clear() is called meanwhile.
+    void restore(const QList<HistoryLog::Record> &tileRecords, const QList<HistoryLog::Record> &imageRecords);
+    void clear();
+
+    Stats stats() const;
+
+private:
+    struct Tile {
+        QByteArray data;      // Memory-only tiles
+        quint64 recordId = 0; // Tiles record, or 0
+        quint32 offset = 0;   // Into the record's payload
+        quint32 size = 0;
+        int refs = 0;
+    };
+
+    // With m_mutex held
+    void retain(const QByteArray &map);
+    // Drops a reference, and the tile with the last one. Returns the Tiles
+    // record that no live tile is in any more, for the caller to remove
+    // from the log once the pool is unlocked, or 0.
+    quint64 unref(quint64 hash);
+    // Writes tiles as one Tiles record and points them at it
+    bool persist(const QList<quint64> &hashes);
+
+    enum Stage {
+        Restored,
+        Locating, // Reading the Tiles directories
+        Counting  // Reading the image maps
+    };
+
+    HistoryLog *m_log;
+    mutable QMutex m_mutex;
+    mutable QWaitCondition m_located;
+    Stage m_stage = Restored;
+    quint64 m_generation = 0; // Bumped by clear()
+    // Maps counted so far, and those released before they were: a restore
+    // skips those, and defers the releases of the counted ones
+    QSet<quint64> m_countedMaps;
+    QSet<quint64> m_skippedMaps;
+    QList<QByteArray> m_deferredReleases;
+    QHash<quint64, Tile> m_tiles;
+    // Tiles record -> tiles still used from it
+    QHash<quint64, int> m_liveTilesByRecord;
+    qint64 m_storedBytes = 0;
+    qint64 m_referencedBytes = 0;
+};
@@ -0,0 +1,260 @@
+#include "trace.h"
+
+#include <QCoreApplication>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QMutex>
+#include <QThread>
+
+#include <algorithm>
+#include <atomic>
+#include <ctime>
+#include <memory>
+#include <vector>
+
+#include <unistd.h>
+
+namespace {
+
+// Per thread; a power of two. About 80 KiB each.
+constexpr quint64 RingSize = 2048;
+
+// A seqlock: odd while being written, 2 * (n + 1) once event n is complete
+struct Slot {
+    std::atomic<quint64> sequence { 0 };
+    std::atomic<qint64> start { 0 };
+    std::atomic<qint64> end { 0 };
+    std::atomic<qint64> value { 0 };
+    std::atomic<quint8> stage { 0 };
+};
+
+struct Ring {
+    int thread = 0;
+    QString name;
+    quint64 written = 0; // Only touched by the owning thread
+    Slot events[RingSize];
+};
+
+// Rings outlive their threads: pooled threads come and go, and a snapshot
+// may still be reading. A ring whose thread has exited goes on the free
+// list and is taken over by the next new thread, so there are only as
+// many rings as threads that ever ran at the same time.
+QMutex g_ringsMutex;
+std::vector<std::unique_ptr<Ring>> g_rings;
+std::vector<Ring *> g_freeRings;
+
+std::atomic<qint64> g_marks[Trace::MarkCount];
+
+// Hands the ring back when its thread exits
+struct RingHolder {
+    Ring *ring = nullptr;
+    ~RingHolder()
+    {
+        if (ring) {
+            QMutexLocker locker(&g_ringsMutex);
+            g_freeRings.push_back(ring);
+        }
+    }
+};
+
+thread_local RingHolder t_ring;
+
+Ring *threadRing()
+{
+    if (!t_ring.ring) {
+        QString name;
+        QThread *thread = QThread::currentThread();
+        if (QCoreApplication::instance() && thread == QCoreApplication::instance()->thread())
+            name = QStringLiteral("GUI");
+        else
+            name = thread->objectName();
+
+        QMutexLocker locker(&g_ringsMutex);
+        Ring *ring;
+        if (!g_freeRings.empty()) {
+            // Its older events stay until overwritten; written carries on,
+            // so their sequence numbers never repeat
+            ring = g_freeRings.back();
+            g_freeRings.pop_back();
+        } else {
+            g_rings.push_back(std::make_unique<Ring>());
+            ring = g_rings.back().get();
+            ring->thread = int(g_rings.size());
+        }
+        ring->name = name.isEmpty() ? QString("Thread %1").arg(ring->thread) : name;
+        t_ring.ring = ring;
+    }
+    return t_ring.ring;
+}
+
+const char *const StageNames[Trace::StageCount] = {
+    "hotkey.event",
+    "hotkey.delivery",
+    "popup.show",
+    "popup.paint",
+    "popup.warm",
+    "startup.ready",
+    "hotkey.to_paint",
+    "capture.debounce",
+    "capture.fetch",
+    "capture.decode",
+    "capture.total",
+    "store.text",
+    "store.image",
+    "paste.encode",
+    "paste.serve",
+};
+
+} // namespace
+
+namespace Trace {
+
+qint64 now()
+{
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return qint64(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+qint64 processStart()
+{
+    static const qint64 start = []() {
+        const qint64 fallback = now();
+        QFile stat(QStringLiteral("/proc/self/stat"));
+        if (!stat.open(QIODevice::ReadOnly))
+            return fallback;
+        // The command name may contain spaces, so fields are counted from
+        // its closing parenthesis. starttime (field 22) is in clock ticks
+        // since boot.
+        const QByteArray line = stat.readAll();
+        const QList<QByteArray> fields = line.mid(line.lastIndexOf(')') + 2).split(' ');
+        const long ticksPerSecond = sysconf(_SC_CLK_TCK);
+        bool ok = false;
+        const qint64 ticks = fields.size() > 19 ? fields.at(19).toLongLong(&ok) : 0;
+        if (!ok || ticksPerSecond <= 0)
+            return fallback;
+
+        // Time since boot counts suspended time too, so the age is carried
+        // over to CLOCK_MONOTONIC rather than the start time itself
+        timespec boot;
+        clock_gettime(CLOCK_BOOTTIME, &boot);
+        const qint64 age = qint64(boot.tv_sec) * 1000000000 + boot.tv_nsec - ticks * (1000000000 / ticksPerSecond);
+        return fallback - qMax<qint64>(0, age);
+    }();
+    return start;
+}
+
+void record(Stage stage, qint64 start, qint64 end, qint64 value)
+{
+    Ring *ring = threadRing();
+    const quint64 n = ring->written++;
+    Slot &slot = ring->events[n & (RingSize - 1)];
+
+    slot.sequence.store(2 * n + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    slot.start.store(start, std::memory_order_relaxed);
+    slot.end.store(end, std::memory_order_relaxed);
+    slot.value.store(value, std::memory_order_relaxed);
+    slot.stage.store(stage, std::memory_order_relaxed);
+    slot.sequence.store(2 * n + 2, std::memory_order_release);
+}
+
+void setMark(Mark mark, qint64 time)
+{
+    g_marks[mark].store(time, std::memory_order_release);
+}
+
+qint64 takeMark(Mark mark)
+{
+    return g_marks[mark].exchange(0, std::memory_order_acq_rel);
+}
+
+const char *stageName(Stage stage)
+{
+    return stage < StageCount ? StageNames[stage] : "unknown";
+}
+
+QList<Event> snapshot()
+{
+    QList<Event> events;
+    QMutexLocker locker(&g_ringsMutex);
+    for (const auto &ring : g_rings) {
+        for (const Slot &slot : ring->events) {
+            const quint64 before = slot.sequence.load(std::memory_order_acquire);
+            if (before == 0 || (before & 1))
+                continue;
+            Event event;
+            event.start = slot.start.load(std::memory_order_relaxed);
+            event.end = slot.end.load(std::memory_order_relaxed);
+            event.value = slot.value.load(std::memory_order_relaxed);
+            event.stage = Stage(slot.stage.load(std::memory_order_relaxed));
+            event.thread = ring->thread;
+            std::atomic_thread_fence(std::memory_order_acquire);
+            // Overwritten while we were reading: skip rather than mix two events
+            if (slot.sequence.load(std::memory_order_relaxed) != before || event.stage >= StageCount)
+                continue;
+            events.append(event);
+        }
+    }
+    return events;
+}
+
+Summary summarize(const QList<Event> &events, Stage stage, bool ofValues)
+{
+    std::vector<qint64> samples;
+    for (const Event &event : events) {
+        if (event.stage == stage)
+            samples.push_back(ofValues ? event.value : event.end - event.start);
+    }
+
+    Summary summary;
+    summary.count = int(samples.size());
+    if (samples.empty())
+        return summary;
+    auto percentile = [&samples](double p) {
+        const auto nth = samples.begin() + std::min(samples.size() - 1, size_t(p * samples.size()));
+        std::nth_element(samples.begin(), nth, samples.end());
+        return *nth;
+    };
+    summary.p50 = percentile(0.50);
+    summary.p99 = percentile(0.99);
+    return summary;
+}
+
+bool writeChromeTrace(const QString &path)
+{
+    const QList<Event> events = snapshot();
+    const qint64 pid = getpid();
+
+    QJsonArray traceEvents;
+    {
+        QMutexLocker locker(&g_ringsMutex);
+        for (const auto &ring : g_rings) {
+            traceEvents.append(QJsonObject {
+                { "ph", "M" }, { "name", "thread_name" }, { "pid", pid }, { "tid", ring->thread },
+                { "args", QJsonObject { { "name", ring->name } } },
+            });
+        }
+    }
+    // Complete events; the format wants microseconds
+    for (const Event &event : events) {
+        traceEvents.append(QJsonObject {
+            { "ph", "X" }, { "cat", "linclip" }, { "name", stageName(event.stage) },
+            { "pid", pid }, { "tid", event.thread },
+            { "ts", event.start / 1000.0 }, { "dur", (event.end - event.start) / 1000.0 },
+            { "args", QJsonObject { { "value", event.value } } },
+        });
+    }
+
+    QFile file(path);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        qWarning("Cannot write the trace to %s: %s", qPrintable(path), qPrintable(file.errorString()));
+        return false;
+    }
+    const QJsonObject trace { { "traceEvents", traceEvents }, { "displayTimeUnit", "ms" } };
+    return file.write(QJsonDocument(trace).toJson(QJsonDocument::Compact)) >= 0;
+}
+
+} // namespace Trace
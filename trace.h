@@ -0,0 +1,94 @@
+#pragma once
+
+#include <QList>
+#include <QString>
+
+// Always-on latency tracing for the hotkey-to-paint and capture paths.
+//
+// Each thread records into its own fixed-size ring buffer, so recording is
+// a handful of relaxed stores with no lock and no allocation (after the
+// thread's first event). Old events are overwritten. snapshot() reads all
+// rings from any thread; every slot is guarded by a sequence number, so an
+// event being overwritten while it is read is skipped, never torn.
+//
+// Timestamps are CLOCK_MONOTONIC nanoseconds.
+namespace Trace {
+
+enum Stage : quint8 {
+    HotkeyEvent,     // X event read -> hotkeyPressed() emitted (hotkey thread)
+    HotkeyDelivery,  // hotkeyPressed() emitted -> slot runs (GUI thread)
+    PopupShow,       // toggleVisibility() showing the window
+    PopupPaint,      // Window shown -> first list paint done
+    PopupWarm,       // Styling, laying out and painting the hidden popup once at startup
+    StartupReady,    // Process start -> deferred startup done, popup warm
+    HotkeyToPaint,   // X event read -> first list paint done
+    CaptureDebounce, // First dataChanged() of a burst -> capture starts
+    CaptureFetch,    // Reading the clipboard (GUI thread) or a selection (selection thread)
+    CaptureDecode,   // Decoding copied image data or an image file (worker)
+    CaptureTotal,    // First dataChanged() -> entry in the history
+    StoreText,       // Adding a text entry; value: bytes stored
+    StoreImage,      // Compressing an image entry; value: bytes stored
+    PasteEncode,     // Encoding an entry for a paste target (worker); value: bytes
+    PasteServe,      // A paste target requested -> its data handed over (GUI thread)
+    StageCount
+};
+
+// Timestamps handed from one thread or call to a later one
+enum Mark {
+    HotkeyReceivedMark,
+    HotkeyEmittedMark,
+    MarkCount
+};
+
+struct Event {
+    Stage stage;
+    qint64 start;
+    qint64 end;
+    qint64 value;
+    int thread; // Index of the thread's ring, stable for the process
+};
+
+struct Summary {
+    int count = 0;
+    qint64 p50 = 0;
+    qint64 p99 = 0;
+};
+
+qint64 now();
+// now() of when the process was started, from the kernel's bookkeeping
+// (clock tick resolution, usually 10 ms), so it includes loading libraries
+qint64 processStart();
+void record(Stage stage, qint64 start, qint64 end, qint64 value = 0);
+
+void setMark(Mark mark, qint64 time);
+// The time last set for mark and clears it, or 0
+qint64 takeMark(Mark mark);
+
+const char *stageName(Stage stage);
+
+// Everything still in the rings, in no particular order
+QList<Event> snapshot();
+// Percentiles of the durations (or values) of stage's events
+Summary summarize(const QList<Event> &events, Stage stage, bool ofValues = false);
+
+// Writes a snapshot in the Chrome trace event format (chrome://tracing,
+// Perfetto). Returns false if the file cannot be written.
+bool writeChromeTrace(const QString &path);
+
+// Records stage from construction to destruction
+class Scope
+{
+public:
+    explicit Scope(Stage stage) : m_stage(stage), m_start(now()) {}
+    ~Scope() { record(m_stage, m_start, now(), m_value); }
+    void setValue(qint64 value) { m_value = value; }
+
+private:
+    Q_DISABLE_COPY(Scope)
+
+    Stage m_stage;
+    qint64 m_start;
+    qint64 m_value = 0;
+};
+
+} // namespace Trace